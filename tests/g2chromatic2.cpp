@@ -55,6 +55,7 @@ struct AnimationConfig {
 Grid2 setup(AnimationConfig config) {
     TIME_FUNCTION;
     Grid2 grid;
+    grid.setLattice(0, 0, config.width, config.height);
     std::vector<Vec2> pos;
     std::vector<Vec4> colors;
     std::vector<float> sizes;
@@ -136,11 +137,10 @@ void expandPixel(Grid2& grid, AnimationConfig config, std::vector<std::tuple<siz
         size_t id = std::get<0>(seed);
         Vec2 seedPOS = std::get<1>(seed);
         Vec4 seedColor = std::get<2>(seed);
-        std::vector<size_t> neighbors = grid.getNeighbors(id);
         //grid.setSize(id, grid.getSize(id)+4);
-        for (size_t neighbor : neighbors) {
+        grid.forEachNeighbor(id, [&](size_t neighbor) {
             if (visitedThisFrame.count(neighbor)) {
-                continue;
+                return;
             }
             visitedThisFrame.insert(neighbor);
 
@@ -164,7 +164,7 @@ void expandPixel(Grid2& grid, AnimationConfig config, std::vector<std::tuple<siz
 
             grid.setColor(neighbor, newcolor);
             newseeds.emplace_back(neighbor, neipos, newcolor);
-        }
+        });
     }
     seeds.clear();
     seeds.shrink_to_fit();
@@ -234,6 +234,7 @@ void mainLogic(const AnimationConfig& config, Shared& state, int gradnoise) {
         if (gradnoise == 0) {
             grid = setup(config);
         } else if (gradnoise == 1) {
+            grid.setLattice(0, 0, config.height, config.width);
             grid = grid.noiseGenGrid(0,0,config.height, config.width, 0.01, 1.0, true, config.noisemod);
         }
         grid.setDefault(Vec4(0,0,0,0));
@@ -267,7 +268,7 @@ void mainLogic(const AnimationConfig& config, Shared& state, int gradnoise) {
             if (i % 10 == 0 ) {
                 frame bgrframe;
                 std::cout << "Processing frame " << i + 1 << "/" << config.totalFrames << std::endl;
-                bgrframe = grid.getGridAsFrame(frame::colormap::BGR);
+                bgrframe = grid.getGridAsFrameIncremental(frame::colormap::BGR);
                 frames.push_back(bgrframe);
                 //bgrframe.decompress();
                 //BMPWriter::saveBMP(std::format("output/grayscalesource.{}.bmp", i), bgrframe);
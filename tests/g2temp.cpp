@@ -55,6 +55,7 @@ struct AnimationConfig {
 Grid2 setup(AnimationConfig config) {
     TIME_FUNCTION;
     Grid2 grid;
+    grid.setLattice(0, 0, config.width, config.height);
     std::vector<Vec2> pos;
     std::vector<Vec4> colors;
     std::vector<float> sizes;
@@ -153,11 +154,10 @@ void expandPixel(Grid2& grid, AnimationConfig config, std::vector<std::tuple<siz
         size_t id = std::get<0>(seed);
         Vec2 seedPOS = std::get<1>(seed);
         Vec4 seedColor = std::get<2>(seed);
-        std::vector<size_t> neighbors = grid.getNeighbors(id);
         //grid.setSize(id, grid.getSize(id)+4);
-        for (size_t neighbor : neighbors) {
+        grid.forEachNeighbor(id, [&](size_t neighbor) {
             if (visitedThisFrame.count(neighbor)) {
-                continue;
+                return;
             }
             visitedThisFrame.insert(neighbor);
 
@@ -181,7 +181,7 @@ void expandPixel(Grid2& grid, AnimationConfig config, std::vector<std::tuple<siz
 
             grid.setColor(neighbor, newcolor);
             newseeds.emplace_back(neighbor, neipos, newcolor);
-        }
+        });
     }
     seeds.clear();
     seeds.shrink_to_fit();
@@ -253,6 +253,7 @@ void mainLogic(const AnimationConfig& config, Shared& state, int gradnoise) {
         if (gradnoise == 0) {
             grid = setup(config);
         } else if (gradnoise == 1) {
+            grid.setLattice(0, 0, config.height, config.width);
             grid = grid.noiseGenGridTemps(0,0,config.height, config.width, 0.01, 1.0, false, config.noisemod);
         }
         grid.setDefault(Vec4(0,0,0,0));
@@ -286,7 +287,7 @@ void mainLogic(const AnimationConfig& config, Shared& state, int gradnoise) {
             }
             
             //expandPixel(grid,config,seeds);
-            grid.diffuseTemps(100);
+            grid.simulateTemps(100);
             
             std::lock_guard<std::mutex> lock(state.mutex);
             state.grid = grid;
@@ -76,7 +76,8 @@ Grid3 setup(AnimationConfig config) {
 void Preview(AnimationConfig config, Grid3& grid) {
     TIME_FUNCTION;
     
-    frame rgbData = grid.getGridAsFrame(Vec2(config.width, config.height), Ray3(Vec3f(config.width + 10,config.height + 10,config.depth + 10), Vec3f(0)), frame::colormap::RGB);
+    Camera3 camera(Vec3f(config.width * 1.8f, config.height * 1.8f, config.depth * 1.8f), Vec3f(config.width, config.height, config.depth) * 0.5f);
+    frame rgbData = grid.getGridAsFrame(Vec2(config.width, config.height), camera, frame::colormap::RGB);
     std::cout << "Frame looks like: " << rgbData << std::endl;
     bool success = BMPWriter::saveBMP("output/grayscalesource3d.bmp", rgbData);
         if (!success) {
@@ -87,7 +88,8 @@ void Preview(AnimationConfig config, Grid3& grid) {
 void livePreview(const Grid3& grid, AnimationConfig config) {
     // std::lock_guard<std::mutex> lock(previewMutex);
     
-    // currentPreviewFrame = grid.getGridAsFrame(Vec2(config.width, config.height), Ray3(Vec3f(config.width + 10,config.height + 10,config.depth + 10), Vec3f(0)), frame::colormap::RGBA);
+    // Camera3 camera(Vec3f(config.width * 1.8f, config.height * 1.8f, config.depth * 1.8f), Vec3f(config.width, config.height, config.depth) * 0.5f);
+    // currentPreviewFrame = grid.getGridAsFrame(Vec2(config.width, config.height), camera, frame::colormap::RGBA);
 
     // glGenTextures(1, &textu);
     // glBindTexture(GL_TEXTURE_2D, textu);
@@ -148,25 +150,24 @@ void expandPixel(Grid3& grid, AnimationConfig config, std::vector<std::tuple<siz
         size_t id = std::get<0>(seed);
         Vec3f seedPOS = std::get<1>(seed);
         Vec4ui8 seedColor = std::get<2>(seed);
-        std::vector<size_t> neighbors = grid.getNeighbors(id);
-        for (size_t neighbor : neighbors) {
+        grid.forEachNeighbor(id, [&](size_t neighbor) {
             std::cout << "counter at 1: " << counter++ << std::endl;
             if (visitedThisFrame.count(neighbor)) {
-                continue;
+                return;
             }
             
             Vec3f neipos;
             try {
                 neipos = grid.getPositionID(neighbor);
             } catch (const std::out_of_range& e) {
-                continue;
+                return;
             }
             Vec4ui8 neighborColor;
             try {
                 neighborColor = grid.getColor(neighbor);
             } catch (const std::out_of_range& e) {
                 // If color doesn't exist, use default or skip
-                continue;
+                return;
             }
             visitedThisFrame.insert(neighbor);
 
@@ -191,7 +192,7 @@ void expandPixel(Grid3& grid, AnimationConfig config, std::vector<std::tuple<siz
             grid.setColor(neighbor, newcolor);
             newseeds.emplace_back(neighbor, neipos, newcolor);
             std::cout << "counter at 3: " << counter++ << std::endl;
-        }
+        });
     }
     seeds.clear();
     seeds.shrink_to_fit();
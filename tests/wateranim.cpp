@@ -84,7 +84,20 @@ void livePreview(const Grid2& grid) {
 }
 
 void flowWater(Grid2& grid, AnimationConfig config) {
-    
+    if (grid.waterCount() == 0) {
+        // drop a block of water into the left half of the scene, one particle per cell center
+        std::vector<Vec2> drops;
+        for (int y = 0; y < config.height / 2; y++) {
+            for (int x = config.width / 8; x < config.width / 2; x++) {
+                drops.push_back(Vec2(x + 0.5f, y + 0.5f));
+            }
+        }
+        grid.setWaterBounds(Vec2(0, 0), Vec2(config.width - 1, config.height - 1));
+        grid.bulkAddWater(drops);
+    }
+    grid.flowWater(1.0f / config.fps);
+    // grid temperatures are in Celsius like the temperature demo
+    grid.exchangeWaterHeat(1.0f / config.fps, 273.15f);
 }
 
 bool exportavi(std::vector<frame> frames, AnimationConfig config) {
@@ -129,7 +142,9 @@ void mainLogic(const AnimationConfig& config, Shared& state, int gradnoise) {
     try {
         Grid2 grid;
         if (gradnoise == 1) {
-            grid = grid.noiseGenGrid(0,0,config.height, config.width, 0.0, 1.0, false, config.noisemod);
+            grid.setLattice(0, 0, config.height, config.width);
+            // the temperature field (0-100 Celsius) is what the water exchanges heat with
+            grid = grid.noiseGenGridTemps(0,0,config.height, config.width, 0.0, 1.0, false, config.noisemod);
         }
         grid.setDefault(Vec4(0,0,0,0));
         {
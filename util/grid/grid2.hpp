@@ -9,11 +9,19 @@
 #include "../output/frame.hpp"
 #include "../noise/pnoise2.hpp"
 #include "../simblocks/water.hpp"
+#include "../simblocks/sph.hpp"
 #include "../simblocks/temp.hpp"
+#include "../simblocks/tempfield.hpp"
+#include "../simblocks/material.hpp"
+#include "../simblocks/scheduler.hpp"
 #include <vector>
 #include <unordered_set>
 #include <execution>
 #include <algorithm>
+#include <numeric>
+#include <atomic>
+#include <cstring>
+#include <limits>
 
 constexpr float EPSILON = 0.0000000000000000000000001;
 
@@ -24,7 +32,7 @@ private:
     std::unordered_map<size_t, Vec2> Positions;
     /// "Positions" reversed - stores the reverse mapping from Vec2 to ID.
     std::unordered_map<Vec2, size_t, Vec2::Hash> ƨnoiƚiƨoꟼ;
-    size_t next_id;
+    size_t next_id = 0;
 public:
     /// @brief Get the Position associated with a specific ID.
     /// @throws std::out_of_range if the ID does not exist.
@@ -54,11 +62,28 @@ public:
         return id;
     }
 
+    /// @brief Registers a position under an existing ID (used when migrating storage so IDs stay stable).
+    void insert(size_t id, const Vec2& pos) {
+        Positions[id] = pos;
+        ƨnoiƚiƨoꟼ[pos] = id;
+        next_id = std::max(next_id, id + 1);
+    }
+
+    /// @brief Moves an existing ID to a new position.
+    void move(size_t id, const Vec2& pos) {
+        Vec2& current = Positions.at(id);
+        auto it = ƨnoiƚiƨoꟼ.find(current);
+        if (it != ƨnoiƚiƨoꟼ.end() && it->second == id) ƨnoiƚiƨoꟼ.erase(it);
+        current = pos;
+        ƨnoiƚiƨoꟼ[pos] = id;
+    }
+
     /// @brief Removes an entry by ID.
     size_t remove(size_t id) {
-        Vec2& pos = Positions[id];
+        Vec2 pos = Positions[id];
         Positions.erase(id);
-        ƨnoiƚiƨoꟼ.erase(pos);
+        auto it = ƨnoiƚiƨoꟼ.find(pos);
+        if (it != ƨnoiƚiƨoꟼ.end() && it->second == id) ƨnoiƚiƨoꟼ.erase(it);
         return id;
     }
 
@@ -132,12 +157,102 @@ public:
 };
 
 /// @brief Accelerates spatial queries by bucketizing positions into a grid.
+/// @details Cells live in a flat open-addressing table keyed by integer cell coordinates. Each cell holds the
+/// head of an intrusive linked list threaded through a per-ID `next` array, so inserting never allocates a
+/// container per cell and range queries walk plain arrays through a visitor instead of copying IDs out.
+/// An ID that is not indexed has `next` set to UNUSED, which is what keeps an ID out of two lists at once.
 class SpatialGrid {
 private:
+    static constexpr size_t UNUSED = std::numeric_limits<size_t>::max();
+    static constexpr size_t NONE = std::numeric_limits<size_t>::max() - 1;
+    /// marks a slot another thread is filling in during bulkInsert
+    static constexpr size_t CLAIMED = std::numeric_limits<size_t>::max() - 2;
+
+    struct Cell {
+        int32_t x;
+        int32_t y;
+        size_t head;
+    };
+
     float cellSize;
+    std::vector<Cell> table;
+    std::vector<size_t> next;
+    size_t usedCells = 0;
+    size_t count = 0;
+
+    static size_t hashCell(int32_t x, int32_t y) {
+        uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(x)) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint64_t>(static_cast<uint32_t>(y)) * 0xC2B2AE3D27D4EB4Full;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+
+    /// @brief Returns the table slot of a cell, or UNUSED if the cell has never been created.
+    size_t findSlot(int32_t x, int32_t y) const {
+        if (table.empty()) return UNUSED;
+        size_t mask = table.size() - 1;
+        for (size_t slot = hashCell(x, y) & mask;; slot = (slot + 1) & mask) {
+            const Cell& cell = table[slot];
+            if (cell.head == UNUSED) return UNUSED;
+            if (cell.x == x && cell.y == y) return slot;
+        }
+    }
+
+    size_t findOrCreateSlot(int32_t x, int32_t y) {
+        if ((usedCells + 1) * 2 > table.size()) rehash(std::max<size_t>(64, table.size() * 2));
+        size_t mask = table.size() - 1;
+        for (size_t slot = hashCell(x, y) & mask;; slot = (slot + 1) & mask) {
+            Cell& cell = table[slot];
+            if (cell.head == UNUSED) {
+                cell = Cell{x, y, NONE};
+                usedCells++;
+                return slot;
+            }
+            if (cell.x == x && cell.y == y) return slot;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        size_t size = 64;
+        while (size < capacity) size *= 2;
+        std::vector<Cell> old = std::move(table);
+        table.assign(size, Cell{0, 0, UNUSED});
+        size_t mask = size - 1;
+        for (const Cell& cell : old) {
+            if (cell.head == UNUSED) continue;
+            size_t slot = hashCell(cell.x, cell.y) & mask;
+            while (table[slot].head != UNUSED) slot = (slot + 1) & mask;
+            table[slot] = cell;
+        }
+    }
+
+    int32_t toCell(float v) const {
+        return static_cast<int32_t>(std::floor(v / cellSize));
+    }
+
+    /// @brief Thread-safe find-or-create used by bulkInsert. Slots are claimed with a CAS on `head`.
+    /// @details The table must already have room for every new cell; it is never rehashed here.
+    size_t claimSlot(int32_t x, int32_t y, bool& created) {
+        created = false;
+        size_t mask = table.size() - 1;
+        for (size_t slot = hashCell(x, y) & mask;; slot = (slot + 1) & mask) {
+            Cell& cell = table[slot];
+            std::atomic_ref<size_t> head(cell.head);
+            size_t h = head.load(std::memory_order_acquire);
+            if (h == UNUSED) {
+                if (head.compare_exchange_strong(h, CLAIMED, std::memory_order_acq_rel)) {
+                    cell.x = x;
+                    cell.y = y;
+                    head.store(NONE, std::memory_order_release);
+                    created = true;
+                    return slot;
+                }
+            }
+            // another thread is writing this slot's key; it is done within a couple of stores
+            while (h == CLAIMED) h = head.load(std::memory_order_acquire);
+            if (cell.x == x && cell.y == y) return slot;
+        }
+    }
 public:
-    std::unordered_map<Vec2, std::unordered_set<size_t>, Vec2::Hash> grid;
-    
     /// @brief Initializes the spatial grid.
     /// @param cellSize The dimension of the spatial buckets. Larger cells mean more items per bucket but fewer buckets.
     SpatialGrid(float cellSize = 2.0f) : cellSize(cellSize) {}
@@ -146,22 +261,92 @@ public:
     Vec2 worldToGrid(const Vec2& worldPos) const {
         return (worldPos / cellSize).floor();
     }
+
+    /// @brief Pre-sizes the cell table and the per-ID links for the expected number of cells and IDs.
+    void reserve(size_t cells, size_t ids) {
+        if (cells * 2 > table.size()) rehash(cells * 2);
+        if (ids > next.size()) next.resize(ids, UNUSED);
+    }
     
+    /// @brief Sort key of the cell containing pos. Keys order cells row by row.
+    uint64_t cellKey(const Vec2& pos) const {
+        uint64_t x = static_cast<uint32_t>(toCell(pos.x)) ^ 0x80000000u;
+        uint64_t y = static_cast<uint32_t>(toCell(pos.y)) ^ 0x80000000u;
+        return (y << 32) | x;
+    }
+
+    /// @brief Inserts the consecutive IDs firstId, firstId + 1, ... in parallel.
+    /// @param positions Positions of those IDs, sorted by cellKey() so each cell is one contiguous run.
+    /// @throws std::invalid_argument if any of the IDs is already indexed.
+    /// @details Each run becomes a ready-made linked list and is spliced onto its cell's head in one step,
+    /// so threads only contend on the CAS that claims a new table slot.
+    void bulkInsert(size_t firstId, const std::vector<Vec2>& positions) {
+        TIME_FUNCTION;
+        size_t n = positions.size();
+        if (n == 0) return;
+        if (firstId + n > next.size()) next.resize(firstId + n, UNUSED);
+        if (std::any_of(std::execution::par, next.begin() + firstId, next.begin() + firstId + n,
+                        [](size_t link) { return link != UNUSED; })) {
+            throw std::invalid_argument("bulkInsert: an ID in the batch is already indexed");
+        }
+
+        std::vector<size_t> index(n);
+        std::iota(index.begin(), index.end(), 0);
+        std::vector<size_t> runStarts(n);
+        auto runEnd = std::copy_if(std::execution::par, index.begin(), index.end(), runStarts.begin(), [&](size_t k) {
+            return k == 0 || cellKey(positions[k]) != cellKey(positions[k - 1]);
+        });
+        runStarts.erase(runEnd, runStarts.end());
+        size_t runs = runStarts.size();
+        if ((usedCells + runs) * 2 > table.size()) rehash((usedCells + runs) * 2);
+
+        std::vector<size_t> created(runs, 0);
+        index.resize(runs);
+        std::for_each(std::execution::par, index.begin(), index.end(), [&](size_t r) {
+            size_t begin = runStarts[r];
+            size_t end = (r + 1 < runs) ? runStarts[r + 1] : n;
+            for (size_t k = begin; k + 1 < end; ++k) {
+                next[firstId + k] = firstId + k + 1;
+            }
+            const Vec2& pos = positions[begin];
+            bool isNew;
+            size_t slot = claimSlot(toCell(pos.x), toCell(pos.y), isNew);
+            created[r] = isNew;
+            // only this run touches this cell, so splicing needs no further synchronisation
+            std::atomic_ref<size_t> head(table[slot].head);
+            size_t oldHead = head.load(std::memory_order_acquire);
+            next[firstId + end - 1] = oldHead;
+            head.store(firstId + begin, std::memory_order_release);
+        });
+        usedCells += std::reduce(created.begin(), created.end(), size_t(0));
+        count += n;
+    }
+
     /// @brief Adds an object ID to the spatial index at the given position.
+    /// @details An ID that is already indexed is left where it is, like a duplicate insert into a set;
+    /// use update() to move it.
     void insert(size_t id, const Vec2& pos) {
-        Vec2 gridPos = worldToGrid(pos);
-        grid[gridPos].insert(id);
+        if (id >= next.size()) next.resize(std::max(id + 1, next.size() * 2), UNUSED);
+        if (next[id] != UNUSED) return;
+        Cell& cell = table[findOrCreateSlot(toCell(pos.x), toCell(pos.y))];
+        next[id] = cell.head;
+        cell.head = id;
+        count++;
     }
     
     /// @brief Removes an object ID from the spatial index.
     void remove(size_t id, const Vec2& pos) {
-        Vec2 gridPos = worldToGrid(pos);
-        auto cellIt = grid.find(gridPos);
-        if (cellIt != grid.end()) {
-            cellIt->second.erase(id);
-            if (cellIt->second.empty()) {
-                grid.erase(cellIt);
+        size_t slot = findSlot(toCell(pos.x), toCell(pos.y));
+        if (slot == UNUSED) return;
+        size_t* link = &table[slot].head;
+        while (*link != NONE) {
+            if (*link == id) {
+                *link = next[id];
+                next[id] = UNUSED;
+                count--;
+                return;
             }
+            link = &next[*link];
         }
     }
     
@@ -175,15 +360,59 @@ public:
             insert(id, newPos);
         }
     }
+
+    bool contains(size_t id) const {
+        return id < next.size() && next[id] != UNUSED;
+    }
+
+    /// @brief Calls fn(id) for every ID in the cell containing 'center'.
+    template<typename Func>
+    void forEachInCell(const Vec2& center, Func&& fn) const {
+        size_t slot = findSlot(toCell(center.x), toCell(center.y));
+        if (slot == UNUSED) return;
+        for (size_t id = table[slot].head; id != NONE; id = next[id]) {
+            fn(id);
+        }
+    }
+
+    /// @brief Returns the first ID in the cell containing 'center' that satisfies pred, or SIZE_MAX if none does.
+    template<typename Pred>
+    size_t findInCell(const Vec2& center, Pred&& pred) const {
+        size_t slot = findSlot(toCell(center.x), toCell(center.y));
+        if (slot == UNUSED) return std::numeric_limits<size_t>::max();
+        for (size_t id = table[slot].head; id != NONE; id = next[id]) {
+            if (pred(id)) return id;
+        }
+        return std::numeric_limits<size_t>::max();
+    }
     
     /// @brief Returns all IDs located in the specific grid cell containing 'center'.
-    std::unordered_set<size_t> find(const Vec2& center) const {
-        //Vec2 g2pos = worldToGrid(center);
-        auto cellIt = grid.find(worldToGrid(center));
-        if (cellIt != grid.end()) {
-            return cellIt->second;
+    std::vector<size_t> find(const Vec2& center) const {
+        std::vector<size_t> results;
+        forEachInCell(center, [&](size_t id) {
+            results.push_back(id);
+        });
+        return results;
+    }
+
+    /// @brief Calls fn(id) for every object in the grid cells overlapping the square around center.
+    /// @details Does not allocate. Candidates still need a distance check by the caller.
+    template<typename Func>
+    void forEachInRange(const Vec2& center, float radius, Func&& fn) const {
+        if (table.empty()) return;
+        int32_t minX = toCell(center.x - radius);
+        int32_t maxX = toCell(center.x + radius);
+        int32_t minY = toCell(center.y - radius);
+        int32_t maxY = toCell(center.y + radius);
+        for (int32_t x = minX; x <= maxX; ++x) {
+            for (int32_t y = minY; y <= maxY; ++y) {
+                size_t slot = findSlot(x, y);
+                if (slot == UNUSED) continue;
+                for (size_t id = table[slot].head; id != NONE; id = next[id]) {
+                    fn(id);
+                }
+            }
         }
-        return std::unordered_set<size_t>();
     }
 
     /// @brief Finds all object IDs within a square area around the center.
@@ -192,31 +421,27 @@ public:
     /// @return A vector of candidate IDs (Note: this returns objects in valid grid cells, further distance checks may be required).
     std::vector<size_t> queryRange(const Vec2& center, float radius) const {
         std::vector<size_t> results;
-        float radiusSq = radius * radius;
-        
-        // Calculate grid bounds for the query
-        Vec2 minGrid = worldToGrid(center - Vec2(radius, radius));
-        Vec2 maxGrid = worldToGrid(center + Vec2(radius, radius));
-        
-        size_t estimatedSize = (maxGrid.x - minGrid.x + 1) * (maxGrid.y - minGrid.y + 1) * 10;
-        results.reserve(estimatedSize);
-
-        // Check all relevant grid cells
-        for (int x = minGrid.x; x <= maxGrid.x; ++x) {
-            for (int y = minGrid.y; y <= maxGrid.y; ++y) {
-                auto cellIt = grid.find(Vec2(x, y));
-                if (cellIt != grid.end()) {
-                    results.insert(results.end(), cellIt->second.begin(), cellIt->second.end());
-                }
-            }
-        }
-        
+        forEachInRange(center, radius, [&](size_t id) {
+            results.push_back(id);
+        });
         return results;
     }
+
+    size_t size() const {
+        return count;
+    }
+
+    float getCellSize() const {
+        return cellSize;
+    }
     
     void clear() {
-        grid.clear();
-        grid.rehash(0);
+        table.clear();
+        table.shrink_to_fit();
+        next.clear();
+        next.shrink_to_fit();
+        usedCells = 0;
+        count = 0;
     }
 };
 
@@ -247,7 +472,180 @@ public:
     void recolor(Vec4 newColor) {
         color.recolor(newColor);
     }
-    
+
+};
+
+/// @brief Contiguous structure-of-arrays storage for grid points.
+/// @details Positions, colors and temperatures live in parallel vectors indexed by a slot number.
+/// The slot doubles as the object ID, so every lookup is a single array index instead of a hash map node.
+/// Removed slots go on a free list and are handed out again by the next insert.
+class DenseStorage2 {
+private:
+    std::vector<Vec2> positions;
+    std::vector<Vec4> colors;
+    std::vector<Temp> temps;
+    std::vector<uint8_t> flags;
+    std::vector<size_t> freeSlots;
+    size_t count = 0;
+    size_t tempcount = 0;
+
+    void grow(size_t slots) {
+        positions.resize(slots);
+        colors.resize(slots);
+        temps.resize(slots);
+        flags.resize(slots, 0);
+    }
+public:
+    static constexpr uint8_t ALIVE = 1;
+    static constexpr uint8_t HAS_TEMP = 2;
+
+    /// @brief Stores a new point, reusing a freed slot when one is available.
+    /// @return The slot (ID) of the new point.
+    size_t add(const Vec2& pos, const Vec4& color) {
+        size_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        } else {
+            slot = positions.size();
+            grow(slot + 1);
+        }
+        place(slot, pos, color);
+        return slot;
+    }
+
+    /// @brief Stores a point in a specific slot, growing the arrays if needed.
+    /// @details Does not touch the free list; call rebuildFreeList() after placing a batch of points.
+    void place(size_t slot, const Vec2& pos, const Vec4& color) {
+        if (slot >= positions.size()) grow(slot + 1);
+        if (!(flags[slot] & ALIVE)) count++;
+        if (flags[slot] & HAS_TEMP) tempcount--;
+        positions[slot] = pos;
+        colors[slot] = color;
+        temps[slot] = Temp();
+        flags[slot] = ALIVE;
+    }
+
+    /// @brief Appends n live slots at the end, leaving the free list alone.
+    /// @details Their data is default-initialized; callers fill position()/color()/temp() afterwards, which
+    /// is safe to do from several threads since every slot is independent.
+    /// @return The first new slot.
+    size_t append(size_t n, bool withTemp = false) {
+        size_t first = positions.size();
+        grow(first + n);
+        std::fill(flags.begin() + first, flags.end(), withTemp ? (ALIVE | HAS_TEMP) : ALIVE);
+        count += n;
+        if (withTemp) tempcount += n;
+        return first;
+    }
+
+    /// @brief Recomputes the free list from the slot flags.
+    void rebuildFreeList() {
+        freeSlots.clear();
+        for (size_t slot = positions.size(); slot-- > 0;) {
+            if (!(flags[slot] & ALIVE)) freeSlots.push_back(slot);
+        }
+    }
+
+    /// @brief Frees a slot. Its data stays in place until the slot is reused.
+    void remove(size_t slot) {
+        if (!contains(slot)) return;
+        if (flags[slot] & HAS_TEMP) tempcount--;
+        flags[slot] = 0;
+        freeSlots.push_back(slot);
+        count--;
+    }
+
+    bool contains(size_t slot) const {
+        return slot < flags.size() && (flags[slot] & ALIVE);
+    }
+
+    const Vec2& position(size_t slot) const {
+        return positions[slot];
+    }
+
+    Vec2& position(size_t slot) {
+        return positions[slot];
+    }
+
+    const Vec4& color(size_t slot) const {
+        return colors[slot];
+    }
+
+    Vec4& color(size_t slot) {
+        return colors[slot];
+    }
+
+    /// @brief Returns the temperature of a slot, or nullptr if none has been set.
+    Temp* temp(size_t slot) {
+        return (slot < flags.size() && (flags[slot] & HAS_TEMP)) ? &temps[slot] : nullptr;
+    }
+
+    const Temp* temp(size_t slot) const {
+        return (slot < flags.size() && (flags[slot] & HAS_TEMP)) ? &temps[slot] : nullptr;
+    }
+
+    void setTemp(size_t slot, const Temp& temp) {
+        if (!(flags[slot] & HAS_TEMP)) tempcount++;
+        temps[slot] = temp;
+        flags[slot] |= HAS_TEMP;
+    }
+
+    /// @brief Number of live points that have a temperature.
+    size_t tempSize() const {
+        return tempcount;
+    }
+
+    /// @brief Number of live points.
+    size_t size() const {
+        return count;
+    }
+
+    /// @brief Number of slots, live or free. Valid IDs are always below this.
+    size_t slots() const {
+        return positions.size();
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    void reserve(size_t size) {
+        positions.reserve(size);
+        colors.reserve(size);
+        temps.reserve(size);
+        flags.reserve(size);
+    }
+
+    void clear() {
+        positions.clear();
+        positions.shrink_to_fit();
+        colors.clear();
+        colors.shrink_to_fit();
+        temps.clear();
+        temps.shrink_to_fit();
+        flags.clear();
+        flags.shrink_to_fit();
+        freeSlots.clear();
+        count = 0;
+        tempcount = 0;
+    }
+
+    /// @brief Calls fn(id, pos) for every live point in slot order.
+    template<typename Func>
+    void forEach(Func&& fn) const {
+        for (size_t slot = 0; slot < positions.size(); ++slot) {
+            if (flags[slot] & ALIVE) fn(slot, positions[slot]);
+        }
+    }
+
+    /// @brief Calls fn(id, temp) for every live point that has a temperature.
+    template<typename Func>
+    void forEachTemp(Func&& fn) {
+        for (size_t slot = 0; slot < positions.size(); ++slot) {
+            if ((flags[slot] & (ALIVE | HAS_TEMP)) == (ALIVE | HAS_TEMP)) fn(slot, temps[slot]);
+        }
+    }
 };
 
 /// @brief The main simulation grid class managing positions, visual data (pixels), and physical properties (temperature, noise).
@@ -265,16 +663,827 @@ protected:
     SpatialGrid spatialGrid;
     float spatialCellSize = neighborRadius * 1.5f;
 
-    // Default background color for empty spaces
-    Vec4 defaultBackgroundColor = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
-    PNoise2 noisegen;
+    // Default background color for empty spaces
+    Vec4 defaultBackgroundColor = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    PNoise2 noisegen;
+
+    //water: kept out of the object set, so it never touches the lattice or the spatial index. waterSolver's
+    //arrays own positions and velocities (their ids are water IDs); water and waterColors are indexed by water ID
+    std::vector<WaterParticle> water;
+    std::vector<Vec4> waterColors;
+    //solver slot of each water ID, refreshed whenever the solver re-sorts
+    std::vector<uint32_t> waterSlots;
+    SPHSolver2 waterSolver;
+    SubstepScheduler waterScheduler = SubstepScheduler("waterSubstep");
+
+    std::unordered_map<size_t, Temp> tempMap;
+    bool regenpreventer = false;
+
+public:
+    /// @brief How diffuseTemps() updates temperatures.
+    enum class HeatSolver {
+        Neighbors,  ///< inverse-distance relaxation over spatial-grid neighbors (works for any point set)
+        Explicit,   ///< lattice stencil, one explicit step per call
+        Implicit    ///< lattice stencil, backward Euler solved with a few Jacobi sweeps
+    };
+protected:
+    //lattice heat solver state: padded (width + 2) x (height + 2) buffers so stencils need no bounds checks
+    HeatSolver heatSolver = HeatSolver::Neighbors;
+    int heatStencil = 5;
+    int heatIterations = 4;
+    std::vector<float> heatTemp;
+    std::vector<float> heatNext;
+    std::vector<float> heatIter;
+    std::vector<float> heatMask;
+    std::vector<float> heatRate;
+    std::vector<Temp*> heatCells;
+    bool heatRedBlack = false;
+    SubstepScheduler heatScheduler = SubstepScheduler("heatSubstep");
+    //cap on the per-substep relaxation fraction, see maxHeatStep()
+    float heatMaxRelax = 1.0f;
+
+    //heatmap colormap stops (0-1 colors, evenly spaced), empty means grayscale
+    std::vector<Vec4> heatPalette;
+
+    /// @brief Color for a normalised temperature t in [0, 1], linearly interpolated between palette stops.
+    Vec4 heatColor(float t) const {
+        if (heatPalette.empty()) return Vec4(t, t, t, 1.0f);
+        if (heatPalette.size() == 1) return heatPalette.front();
+        float pos = t * (heatPalette.size() - 1);
+        size_t i = std::min(static_cast<size_t>(pos), heatPalette.size() - 2);
+        float f = pos - i;
+        return heatPalette[i] * (1.0f - f) + heatPalette[i + 1] * f;
+    }
+
+    //thermal materials referenced by Temp::material
+    MaterialTable materials;
+
+    //interpolation index over temperature samples, see temperatureField()
+    TempField tempField;
+    bool tempFieldValid = false;
+
+    //axis-aligned bounds of all objects, grown on insert and recomputed lazily once a boundary point leaves
+    mutable bool boundsValid = false;
+    mutable Vec2 boundsMin;
+    mutable Vec2 boundsMax;
+
+    //last frame from getGridAsFrameIncremental(), plus the positions touched since it was drawn
+    struct RenderCache {
+        bool valid = false;
+        frame::colormap format = frame::colormap::RGB;
+        Vec2 minCorner;
+        Vec2 maxCorner;
+        float scaleX = 1.0f;
+        float scaleY = 1.0f;
+        frame image;
+        std::vector<Vec2> dirty;
+    };
+    RenderCache renderCache;
+
+    //dense storage (replaces Positions, Pixels and tempMap when enabled)
+    DenseStorage2 dense;
+    bool denseStorage = false;
+
+    /// @brief Calls fn(id, pos) for every object, whichever storage is active.
+    template<typename Func>
+    void forEachPosition(Func&& fn) const {
+        if (denseStorage) {
+            dense.forEach(fn);
+        } else {
+            for (const auto& [id, pos] : Positions) {
+                fn(id, pos);
+            }
+        }
+    }
+
+    /// @brief Calls fn(id, temp) for every object that has a temperature.
+    template<typename Func>
+    void forEachTemp(Func&& fn) {
+        if (denseStorage) {
+            dense.forEachTemp(fn);
+        } else {
+            for (auto& [id, temp] : tempMap) {
+                fn(id, temp);
+            }
+        }
+    }
+
+    /// @brief Returns the temperature for an ID, or nullptr if it has none.
+    Temp* findTemp(size_t id) {
+        if (denseStorage) return dense.temp(id);
+        auto it = tempMap.find(id);
+        return it != tempMap.end() ? &it->second : nullptr;
+    }
+
+    const Temp* findTemp(size_t id) const {
+        if (denseStorage) return dense.temp(id);
+        auto it = tempMap.find(id);
+        return it != tempMap.end() ? &it->second : nullptr;
+    }
+
+    void storeTemp(size_t id, const Temp& temp) {
+        storeInterpolatedTemp(id, temp);
+        tempFieldValid = false;
+    }
+
+    /// @brief Stores a temperature that was interpolated from tempField, which therefore stays valid.
+    void storeInterpolatedTemp(size_t id, const Temp& temp) {
+        if (denseStorage) dense.setTemp(id, temp);
+        else tempMap.insert_or_assign(id, temp);
+    }
+
+    /// @brief KD-tree over every temperature sample, rebuilt on demand after temperatures change.
+    const TempField& temperatureField() {
+        if (!tempFieldValid) {
+            std::vector<Vec2> positions;
+            std::vector<float> values;
+            positions.reserve(tempCount());
+            values.reserve(tempCount());
+            forEachTemp([&](size_t id, Temp& temp) {
+                positions.push_back(positionOf(id));
+                values.push_back(temp.temp);
+            });
+            tempField.build(positions, values);
+            tempFieldValid = true;
+        }
+        return tempField;
+    }
+
+    size_t tempCount() const {
+        return denseStorage ? dense.tempSize() : tempMap.size();
+    }
+
+    /// @brief Unchecked position lookup for IDs that came out of the spatial index.
+    Vec2 positionOf(size_t id) const {
+        return denseStorage ? dense.position(id) : Positions.at(id);
+    }
+
+    /// @brief Exact-position membership test that works in both storage modes.
+    bool containsPosition(const Vec2& pos) const {
+        size_t index;
+        if (latticeIndex(pos, index)) {
+            if (latticeIDs[index] != NO_ID) return true;
+            if (offLatticeCount == 0) return false;
+        }
+        if (!denseStorage) return Positions.contains(pos);
+        return spatialGrid.findInCell(pos, [&](size_t id) {
+            return dense.position(id) == pos;
+        }) != NO_ID;
+    }
+
+    //integer lattice fast path (row-major ID table over a known rectangle)
+    static constexpr size_t NO_ID = std::numeric_limits<size_t>::max();
+    bool latticeMode = false;
+    int latticeMinX = 0;
+    int latticeMinY = 0;
+    size_t latticeWidth = 0;
+    size_t latticeHeight = 0;
+    std::vector<size_t> latticeIDs;
+    /// number of objects that are not held by the lattice (off-lattice positions or duplicates)
+    size_t offLatticeCount = 0;
+
+    /// @brief Maps a whole-cell position inside the lattice bounds to its row-major index.
+    /// @return false if the position is fractional or outside the lattice.
+    bool latticeIndex(const Vec2& pos, size_t& index) const {
+        if (!latticeMode) return false;
+        float fx = pos.x - latticeMinX;
+        float fy = pos.y - latticeMinY;
+        if (fx < 0 || fy < 0 || fx >= latticeWidth || fy >= latticeHeight) return false;
+        size_t ix = static_cast<size_t>(fx);
+        size_t iy = static_cast<size_t>(fy);
+        if (ix != fx || iy != fy) return false;
+        index = iy * latticeWidth + ix;
+        return true;
+    }
+
+    void latticeInsert(size_t id, const Vec2& pos) {
+        if (!latticeMode) return;
+        size_t index;
+        if (latticeIndex(pos, index) && latticeIDs[index] == NO_ID) {
+            latticeIDs[index] = id;
+        } else {
+            offLatticeCount++;
+        }
+    }
+
+    void latticeRemove(size_t id, const Vec2& pos) {
+        if (!latticeMode) return;
+        size_t index;
+        if (latticeIndex(pos, index) && latticeIDs[index] == id) {
+            latticeIDs[index] = NO_ID;
+        } else if (offLatticeCount > 0) {
+            offLatticeCount--;
+        }
+    }
+
+    /// @brief True when every object lives on the lattice, so the sparse structures never need consulting.
+    bool latticeOnly() const {
+        return latticeMode && offLatticeCount == 0;
+    }
+
+    /// @brief Calls fn(id, pos) for every lattice object within radius of a whole-cell position.
+    /// @return false if the lattice cannot answer the query and the caller must use the spatial grid.
+    template<typename Func>
+    bool forEachLatticeNeighbor(const Vec2& pos, float radius, Func&& fn) const {
+        size_t center;
+        if (!latticeOnly() || !latticeIndex(pos, center)) return false;
+        int cx = static_cast<int>(pos.x) - latticeMinX;
+        int cy = static_cast<int>(pos.y) - latticeMinY;
+        int r = static_cast<int>(std::floor(radius));
+        float radiusSq = radius * radius;
+        int y0 = std::max(cy - r, 0);
+        int y1 = std::min(cy + r, static_cast<int>(latticeHeight) - 1);
+        int x0 = std::max(cx - r, 0);
+        int x1 = std::min(cx + r, static_cast<int>(latticeWidth) - 1);
+        for (int y = y0; y <= y1; ++y) {
+            int dy = y - cy;
+            const size_t* row = latticeIDs.data() + static_cast<size_t>(y) * latticeWidth;
+            for (int x = x0; x <= x1; ++x) {
+                int dx = x - cx;
+                if (dx * dx + dy * dy > radiusSq) continue;
+                size_t id = row[x];
+                if (id != NO_ID) fn(id, Vec2(x + latticeMinX, y + latticeMinY));
+            }
+        }
+        return true;
+    }
+
+    /// @brief Calls fn(id, pos) for every lattice object inside an axis-aligned region (inclusive).
+    template<typename Func>
+    void forEachLatticeInRegion(const Vec2& minCorner, const Vec2& maxCorner, Func&& fn) const {
+        int x0 = std::max(static_cast<int>(std::ceil(minCorner.x)) - latticeMinX, 0);
+        int y0 = std::max(static_cast<int>(std::ceil(minCorner.y)) - latticeMinY, 0);
+        int x1 = std::min(static_cast<int>(std::floor(maxCorner.x)) - latticeMinX, static_cast<int>(latticeWidth) - 1);
+        int y1 = std::min(static_cast<int>(std::floor(maxCorner.y)) - latticeMinY, static_cast<int>(latticeHeight) - 1);
+        for (int y = y0; y <= y1; ++y) {
+            const size_t* row = latticeIDs.data() + static_cast<size_t>(y) * latticeWidth;
+            for (int x = x0; x <= x1; ++x) {
+                if (row[x] != NO_ID) fn(row[x], Vec2(x + latticeMinX, y + latticeMinY));
+            }
+        }
+    }
+
+    //cached neighbor lists in CSR form (offsets into a packed ID array), built by updateNeighborMap()
+    bool neighborCacheEnabled = false;
+    float cachedNeighborRadius = 0.0f;
+    std::vector<size_t> neighborOffsets;
+    std::vector<size_t> neighborIDs;
+    /// per ID: 1 when the cached list is stale and queries must go to the spatial index
+    std::vector<uint8_t> neighborDirty;
+    size_t dirtyNeighborCount = 0;
+
+    bool hasID(size_t id) const {
+        return denseStorage ? dense.contains(id) : Positions.contains(id);
+    }
+
+    /// @brief Marks the cached neighbor lists around a position as stale.
+    /// @details Called before and after anything that adds, removes or moves an object there.
+    void invalidateNeighborCache(const Vec2& pos) {
+        if (!neighborCacheEnabled) return;
+        forEachInRadius(pos, cachedNeighborRadius, [&](size_t id) {
+            if (id < neighborDirty.size() && !neighborDirty[id]) {
+                neighborDirty[id] = 1;
+                dirtyNeighborCount++;
+            }
+        });
+    }
+
+    std::vector<size_t> insertBatch(const std::vector<Vec2>& poses, const std::vector<Vec4>& colors, const std::vector<float>* temps) {
+        size_t n = poses.size();
+        std::vector<size_t> ids(n);
+        if (n == 0) return ids;
+
+        // order points by spatial cell; rank in this order is the offset of each ID from the first one
+        std::vector<uint64_t> keys(n);
+        std::transform(std::execution::par_unseq, poses.begin(), poses.end(), keys.begin(), [&](const Vec2& pos) {
+            return spatialGrid.cellKey(pos);
+        });
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(std::execution::par, order.begin(), order.end(), [&](size_t a, size_t b) {
+            return keys[a] != keys[b] ? keys[a] < keys[b] : a < b;
+        });
+
+        size_t firstId;
+        if (denseStorage) {
+            firstId = dense.append(n, temps != nullptr);
+        } else {
+            firstId = Positions.getNext_id() - 1;
+            Positions.reserve(Positions.size() + n);
+            Pixels.reserve(Pixels.size() + n);
+            if (temps) tempMap.reserve(tempMap.size() + n);
+            for (size_t k = 0; k < n; ++k) {
+                size_t i = order[k];
+                size_t id = Positions.set(poses[i]);
+                Pixels.emplace(id, GenericPixel(id, colors[i], poses[i]));
+                if (temps) tempMap.insert_or_assign(id, Temp((*temps)[i]));
+            }
+        }
+
+        std::vector<Vec2> sorted(n);
+        std::vector<size_t> rank(n);
+        std::iota(rank.begin(), rank.end(), 0);
+        std::for_each(std::execution::par, rank.begin(), rank.end(), [&](size_t k) {
+            size_t i = order[k];
+            size_t id = firstId + k;
+            ids[i] = id;
+            sorted[k] = poses[i];
+            if (denseStorage) {
+                dense.position(id) = poses[i];
+                dense.color(id) = colors[i];
+                if (temps) *dense.temp(id) = Temp((*temps)[i]);
+            }
+            if (latticeMode) {
+                // the lowest ID keeps a shared lattice point, same as inserting one at a time
+                size_t index;
+                size_t displaced = id;
+                if (latticeIndex(poses[i], index)) {
+                    std::atomic_ref<size_t> cell(latticeIDs[index]);
+                    displaced = cell.load(std::memory_order_relaxed);
+                    while (id < displaced && !cell.compare_exchange_weak(displaced, id, std::memory_order_relaxed)) {}
+                }
+                if (displaced != NO_ID) std::atomic_ref<size_t>(offLatticeCount).fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        spatialGrid.bulkInsert(firstId, sorted);
+        updateNeighborMap();
+        invalidateRender();
+        if (temps) tempFieldValid = false;
+        if (boundsValid) {
+            for (const Vec2& pos : sorted) growBounds(pos);
+        }
+        return ids;
+    }
+
+    /// @brief Evaluates the noise generator over an integer region, one column per task.
+    /// @details Each column samples its noise coordinates in batches into column-local buffers; the columns are
+    /// then concatenated in x-major order straight into the output vectors for bulkAddObjects.
+    void noiseFill(size_t minx, size_t miny, size_t maxx, size_t maxy, float minChance, float maxChance,
+                   bool color, int noisemod, std::vector<Vec2>& poses, std::vector<Vec4>& colors,
+                   std::vector<float>* temps) const {
+        struct Column {
+            std::vector<Vec2> poses;
+            std::vector<Vec4> colors;
+            std::vector<float> temps;
+        };
+        if (maxx <= minx || maxy <= miny) return;
+        size_t height = maxy - miny;
+        std::vector<size_t> xs(maxx - minx);
+        std::iota(xs.begin(), xs.end(), minx);
+        std::vector<Column> columns(xs.size());
+
+        std::for_each(std::execution::par, xs.begin(), xs.end(), [&](size_t x) {
+            std::vector<float> nx(height, (x + noisemod) / (maxx + EPSILON) / 0.1);
+            std::vector<float> ny(height);
+            for (size_t j = 0; j < height; ++j) {
+                ny[j] = (miny + j + noisemod) / (maxy + EPSILON) / 0.1;
+            }
+            std::vector<float> alpha(height);
+            noisegen.sampleBatch(nx.data(), ny.data(), alpha.data(), height);
+
+            // compact the kept samples so the color passes only evaluate those
+            std::vector<size_t> keep;
+            for (size_t j = 0; j < height; ++j) {
+                if (alpha[j] > minChance && alpha[j] < maxChance) keep.push_back(j);
+            }
+            size_t kept = keep.size();
+            std::vector<float> kx(kept, nx[0]);
+            std::vector<float> ky(kept);
+            for (size_t k = 0; k < kept; ++k) ky[k] = ny[keep[k]];
+
+            Column& column = columns[x - minx];
+            column.poses.resize(kept);
+            column.colors.resize(kept);
+            for (size_t k = 0; k < kept; ++k) {
+                column.poses[k] = Vec2(x, miny + keep[k]);
+            }
+            if (color) {
+                std::vector<float> red(kept), green(kept), blue(kept);
+                noisegen.sampleBatch(kx.data(), ky.data(), red.data(), kept, 0.3f, 0.3f);
+                noisegen.sampleBatch(kx.data(), ky.data(), green.data(), kept, 0.6f, 0.06f);
+                noisegen.sampleBatch(kx.data(), ky.data(), blue.data(), kept, 0.9f, 0.9f);
+                for (size_t k = 0; k < kept; ++k) {
+                    column.colors[k] = Vec4(red[k], green[k], blue[k], 1.0);
+                }
+            } else {
+                for (size_t k = 0; k < kept; ++k) {
+                    float a = alpha[keep[k]];
+                    column.colors[k] = Vec4(a, a, a, 1.0);
+                }
+            }
+            if (temps) {
+                column.temps.resize(kept);
+                std::vector<float> tx(kept), ty(kept);
+                for (size_t k = 0; k < kept; ++k) {
+                    tx[k] = kx[k] * 0.2f + 1;
+                    ty[k] = ky[k] * 0.1f + 2;
+                }
+                noisegen.sampleBatch(tx.data(), ty.data(), column.temps.data(), kept);
+                for (float& t : column.temps) t *= 100;
+            }
+        });
+
+        std::vector<size_t> offsets(columns.size() + 1, 0);
+        for (size_t c = 0; c < columns.size(); ++c) {
+            offsets[c + 1] = offsets[c] + columns[c].poses.size();
+        }
+        size_t base = poses.size();
+        poses.resize(base + offsets.back());
+        colors.resize(base + offsets.back());
+        if (temps) temps->resize(base + offsets.back());
+        std::for_each(std::execution::par, xs.begin(), xs.end(), [&](size_t x) {
+            const Column& column = columns[x - minx];
+            size_t out = base + offsets[x - minx];
+            std::copy(column.poses.begin(), column.poses.end(), poses.begin() + out);
+            std::copy(column.colors.begin(), column.colors.end(), colors.begin() + out);
+            if (temps) std::copy(column.temps.begin(), column.temps.end(), temps->begin() + out);
+        });
+    }
+
+    /// @brief Maps a world region onto an output image split into square tiles.
+    struct RegionRaster {
+        static constexpr size_t TILE = 64;
+        Vec2 minCorner;
+        Vec2 maxCorner;
+        size_t width;
+        size_t height;
+        float scaleX;
+        float scaleY;
+        size_t tilesX;
+        /// tile indices, for handing to std::for_each
+        std::vector<size_t> tiles;
+
+        RegionRaster(const Vec2& minCorner, const Vec2& maxCorner, size_t width, size_t height, float scaleX, float scaleY)
+            : minCorner(minCorner), maxCorner(maxCorner), width(width), height(height), scaleX(scaleX), scaleY(scaleY) {
+            tilesX = (width + TILE - 1) / TILE;
+            tiles.resize(tilesX * ((height + TILE - 1) / TILE));
+            std::iota(tiles.begin(), tiles.end(), 0);
+        }
+
+        /// @brief Output pixel index of a world position, false if it is outside the region.
+        bool pixelOf(const Vec2& pos, size_t& pixel) const {
+            if (pos.x < minCorner.x || pos.x > maxCorner.x || pos.y < minCorner.y || pos.y > maxCorner.y) return false;
+            size_t x = std::min(static_cast<size_t>((pos.x - minCorner.x) * scaleX), width - 1);
+            size_t y = std::min(static_cast<size_t>((pos.y - minCorner.y) * scaleY), height - 1);
+            pixel = y * width + x;
+            return true;
+        }
+
+        size_t tileOf(size_t pixel) const {
+            return (pixel / width / TILE) * tilesX + (pixel % width) / TILE;
+        }
+
+        /// @brief World rectangle covering a tile, padded by a cell so edge pixels are not missed.
+        void tileWorldBounds(size_t tile, Vec2& tileMin, Vec2& tileMax) const {
+            size_t x0 = (tile % tilesX) * TILE;
+            size_t y0 = (tile / tilesX) * TILE;
+            size_t x1 = std::min(x0 + TILE, width);
+            size_t y1 = std::min(y0 + TILE, height);
+            tileMin = Vec2(std::max(minCorner.x, minCorner.x + x0 / scaleX - 1),
+                           std::max(minCorner.y, minCorner.y + y0 / scaleY - 1));
+            tileMax = Vec2(std::min(maxCorner.x, minCorner.x + x1 / scaleX + 1),
+                           std::min(maxCorner.y, minCorner.y + y1 / scaleY + 1));
+        }
+
+        template<typename Func>
+        void forEachPixel(size_t tile, Func&& fn) const {
+            size_t x0 = (tile % tilesX) * TILE;
+            size_t y0 = (tile / tilesX) * TILE;
+            size_t x1 = std::min(x0 + TILE, width);
+            size_t y1 = std::min(y0 + TILE, height);
+            for (size_t y = y0; y < y1; ++y) {
+                for (size_t x = x0; x < x1; ++x) {
+                    fn(y * width + x);
+                }
+            }
+        }
+    };
+
+    static size_t frameChannels(frame::colormap format) {
+        switch (format) {
+            case frame::colormap::RGBA:
+            case frame::colormap::BGRA: return 4;
+            case frame::colormap::B: return 1;
+            default: return 3;
+        }
+    }
+
+    /// @brief Writes a 0-255 color into one pixel of a buffer in the given channel layout.
+    static void writePixel(uint8_t* out, const Vec4& color, frame::colormap format) {
+        switch (format) {
+            case frame::colormap::RGBA:
+                out[0] = color.r; out[1] = color.g; out[2] = color.b; out[3] = color.a;
+                break;
+            case frame::colormap::BGR:
+                out[0] = color.b; out[1] = color.g; out[2] = color.r;
+                break;
+            case frame::colormap::BGRA:
+                out[0] = color.b; out[1] = color.g; out[2] = color.r; out[3] = color.a;
+                break;
+            case frame::colormap::B:
+                out[0] = (color.r + color.g + color.b) / 3;
+                break;
+            case frame::colormap::RGB:
+            default:
+                out[0] = color.r; out[1] = color.g; out[2] = color.b;
+                break;
+        }
+    }
+
+    void growBounds(const Vec2& pos) {
+        if (!boundsValid) return;
+        boundsMin.x = std::min(boundsMin.x, pos.x);
+        boundsMin.y = std::min(boundsMin.y, pos.y);
+        boundsMax.x = std::max(boundsMax.x, pos.x);
+        boundsMax.y = std::max(boundsMax.y, pos.y);
+    }
+
+    /// @brief Called when an object leaves pos; only a point on the boundary can shrink the bounds.
+    void shrinkBounds(const Vec2& pos) {
+        if (boundsValid && (pos.x == boundsMin.x || pos.y == boundsMin.y ||
+                            pos.x == boundsMax.x || pos.y == boundsMax.y)) {
+            boundsValid = false;
+        }
+    }
+
+    /// @brief Weighted neighbor sums of the stencil around padded index i: same 1/d^2 weights as Temp::calLapl.
+    void stencilSums(const float* temp, size_t i, size_t stride, float& sumW, float& sumTW) const {
+        const float* m = heatMask.data();
+        sumW = m[i - 1] + m[i + 1] + m[i - stride] + m[i + stride];
+        sumTW = m[i - 1] * temp[i - 1] + m[i + 1] * temp[i + 1] + m[i - stride] * temp[i - stride] + m[i + stride] * temp[i + stride];
+        if (heatStencil == 9) {
+            sumW += 0.5f * (m[i - stride - 1] + m[i - stride + 1] + m[i + stride - 1] + m[i + stride + 1]);
+            sumTW += 0.5f * (m[i - stride - 1] * temp[i - stride - 1] + m[i - stride + 1] * temp[i - stride + 1] +
+                             m[i + stride - 1] * temp[i + stride - 1] + m[i + stride + 1] * temp[i + stride + 1]);
+        }
+    }
+
+    /// @brief Stencil version of diffuseTemps() for grids where every object sits on the lattice.
+    /// @details Temperatures are gathered into flat buffers, relaxed toward the weighted mean of their stencil
+    /// neighbors with the same rate as Temp::calLapl, and written back. Rows are processed in parallel and
+    /// every sweep reads one buffer and writes another, so results do not depend on thread scheduling.
+    void diffuseLattice(float deltaTime) {
+        TIME_FUNCTION;
+        size_t width = latticeWidth;
+        size_t height = latticeHeight;
+        size_t stride = width + 2;
+        size_t padded = stride * (height + 2);
+        heatTemp.assign(padded, 0.0f);
+        heatMask.assign(padded, 0.0f);
+        heatRate.assign(padded, 0.0f);
+        heatNext.resize(padded);
+        heatCells.assign(width * height, nullptr);
+        bool implicit = heatSolver == HeatSolver::Implicit;
+        const float* rates = materials.rateTable();
+
+        std::vector<size_t> rows(height);
+        std::iota(rows.begin(), rows.end(), 0);
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+            for (size_t x = 0; x < width; ++x) {
+                size_t id = latticeIDs[y * width + x];
+                Temp* temp = id != NO_ID ? findTemp(id) : nullptr;
+                if (!temp) continue;
+                size_t i = (y + 1) * stride + x + 1;
+                heatCells[y * width + x] = temp;
+                heatTemp[i] = temp->temp;
+                heatMask[i] = 1.0f;
+                float rate = rates[temp->material];
+                heatRate[i] = implicit ? rate * deltaTime : 1.0f - std::exp(-rate * deltaTime);
+            }
+        });
+
+        if (!implicit) {
+            std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+                size_t row = (y + 1) * stride;
+                for (size_t i = row + 1; i <= row + width; ++i) {
+                    float sumW, sumTW;
+                    stencilSums(heatTemp.data(), i, stride, sumW, sumTW);
+                    // cells without neighbors have sumW == sumTW == 0 and keep their value
+                    heatNext[i] = heatTemp[i] + heatRate[i] * (sumTW - sumW * heatTemp[i]) / std::max(sumW, 1e-10f);
+                }
+            });
+        } else {
+            // backward Euler: T' = T + a (mean(T') - T'), iterated as T'_{k+1} = (T + a mean(T'_k)) / (1 + a)
+            heatIter = heatTemp;
+            for (int k = 0; k < heatIterations; ++k) {
+                std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+                    size_t row = (y + 1) * stride;
+                    for (size_t i = row + 1; i <= row + width; ++i) {
+                        float sumW, sumTW;
+                        stencilSums(heatIter.data(), i, stride, sumW, sumTW);
+                        float a = sumW > 0.0f ? heatRate[i] : 0.0f;
+                        float mean = sumTW / std::max(sumW, 1e-10f);
+                        heatNext[i] = (heatTemp[i] + a * mean) / (1.0f + a);
+                    }
+                });
+                std::swap(heatIter, heatNext);
+            }
+            std::swap(heatIter, heatNext);
+        }
+
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+            for (size_t x = 0; x < width; ++x) {
+                if (Temp* temp = heatCells[y * width + x]) temp->temp = heatNext[(y + 1) * stride + x + 1];
+            }
+        });
+    }
+
+    /// @brief Neighbor version of diffuseTemps(): every temperature relaxes toward the inverse-distance mean of
+    /// the temperatures around it, as in Temp::calLapl.
+    /// @details Reads come from a snapshot taken before the step and writes go to a separate buffer, so the
+    /// result does not depend on how the parallel loop is scheduled. With red-black ordering, points on even
+    /// cells (x + y) are updated first and odd cells then read their new values, which converges faster.
+    void diffuseNeighbors(float deltaTime) {
+        size_t slots = denseStorage ? dense.slots() : Positions.getNext_id();
+        std::vector<float> current(slots, 0.0f);
+        std::vector<uint8_t> hasTemp(slots, 0);
+        std::vector<size_t> ids;
+        std::vector<Temp*> temps;
+        ids.reserve(tempCount());
+        temps.reserve(tempCount());
+        forEachTemp([&](size_t id, Temp& tempObj) {
+            ids.push_back(id);
+            temps.push_back(&tempObj);
+            current[id] = tempObj.temp;
+            hasTemp[id] = 1;
+        });
+
+        // positions by ID, so neighbors are read from an array rather than looked up per visit
+        size_t count = ids.size();
+        std::vector<Vec2> positions(slots);
+        std::vector<float> next(count);
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::for_each(std::execution::par, order.begin(), order.end(), [&](size_t k) {
+            positions[ids[k]] = positionOf(ids[k]);
+        });
+
+        const float* conductivities = materials.conductivityTable();
+        const float* rates = materials.rateTable();
+        auto relax = [&](size_t k) {
+            size_t id = ids[k];
+            const Vec2& pos = positions[id];
+            float sumWeights = 0.0f;
+            float sumTempWeights = 0.0f;
+            spatialGrid.forEachInRange(pos, neighborRadius * conductivities[temps[k]->material], [&](size_t neighborId) {
+                if (neighborId == id || !hasTemp[neighborId]) return;
+                float weight = Temp::laplWeight(pos.distance(positions[neighborId]));
+                sumTempWeights += weight * current[neighborId];
+                sumWeights += weight;
+            });
+            Temp old = *temps[k];
+            old.temp = current[id];
+            next[k] = sumWeights < 1e-10f ? old.temp : old.relaxed(sumTempWeights / sumWeights, deltaTime, rates[old.material]);
+        };
+
+        if (heatRedBlack) {
+            auto odd = std::stable_partition(order.begin(), order.end(), [&](size_t k) {
+                const Vec2& pos = positions[ids[k]];
+                return ((static_cast<int>(std::floor(pos.x)) + static_cast<int>(std::floor(pos.y))) & 1) == 0;
+            });
+            for (auto [begin, end] : {std::pair{order.begin(), odd}, std::pair{odd, order.end()}}) {
+                std::for_each(std::execution::par, begin, end, relax);
+                std::for_each(std::execution::par, begin, end, [&](size_t k) {
+                    current[ids[k]] = next[k];
+                });
+            }
+        } else {
+            std::for_each(std::execution::par, order.begin(), order.end(), relax);
+        }
+
+        std::for_each(std::execution::par, order.begin(), order.end(), [&](size_t k) {
+            temps[k]->temp = next[k];
+        });
+    }
+
+    /// @brief Records a position whose pixel must be redrawn by the next incremental render.
+    /// @param leaving True when an object is leaving pos; leaving the edge of the cached bounds shrinks them,
+    /// which needs a full redraw.
+    void markDirty(const Vec2& pos, bool leaving = false) {
+        if (!renderCache.valid) return;
+        if (leaving && (pos.x == renderCache.minCorner.x || pos.y == renderCache.minCorner.y ||
+                        pos.x == renderCache.maxCorner.x || pos.y == renderCache.maxCorner.y)) {
+            invalidateRender();
+            return;
+        }
+        renderCache.dirty.push_back(pos);
+    }
+
+    void invalidateRender() {
+        renderCache.valid = false;
+        renderCache.dirty.clear();
+    }
+
+    /// @brief Redraws one output pixel of the cached frame from the objects that currently fall in it.
+    void redrawPixel(const RegionRaster& raster, size_t pixel, uint8_t* out) const {
+        size_t px = pixel % raster.width;
+        size_t py = pixel / raster.width;
+        Vec2 lo(raster.minCorner.x + px / raster.scaleX, raster.minCorner.y + py / raster.scaleY);
+        Vec2 hi(raster.minCorner.x + (px + 1) / raster.scaleX, raster.minCorner.y + (py + 1) / raster.scaleY);
+        Vec4 sum(0, 0, 0, 0);
+        uint32_t count = 0;
+        auto accumulate = [&](size_t id, const Vec2& pos) {
+            size_t target;
+            if (raster.pixelOf(pos, target) && target == pixel) {
+                sum += denseStorage ? dense.color(id) : Pixels.at(id).getColor();
+                count++;
+            }
+        };
+        if (latticeOnly()) {
+            forEachLatticeInRegion(lo - 1, hi + 1, accumulate);
+        } else {
+            Vec2 center = (lo + hi) / 2;
+            float radius = std::max(hi.x - lo.x, hi.y - lo.y) / 2 + 1;
+            spatialGrid.forEachInRange(center, radius, [&](size_t id) {
+                accumulate(id, positionOf(id));
+            });
+        }
+        Vec4 color = count > 0 ? sum / static_cast<float>(count) * 255 : defaultBackgroundColor;
+        writePixel(out, color, renderCache.format);
+    }
+
+    /// @brief Neighbor query straight from the spatial index, bypassing the cache.
+    template<typename Func>
+    void forEachNeighborLive(size_t id, float radius, Func&& fn) const {
+        Vec2 pos = getPositionID(id);
+        forEachInRadius(pos, radius, [&](size_t candidateId) {
+            if (candidateId != id) fn(candidateId);
+        });
+    }
+public:
+    /// @brief Switches between hash map storage and dense structure-of-arrays storage.
+    /// @details Existing objects are migrated and keep their IDs. In dense mode IDs are slot indices,
+    /// and removed IDs are reused by later inserts.
+    /// @return Reference to self for chaining.
+    Grid2& useDenseStorage(bool enable = true) {
+        TIME_FUNCTION;
+        if (enable == denseStorage) return *this;
+        if (enable) {
+            dense.clear();
+            dense.reserve(Positions.getNext_id());
+            for (const auto& [id, pos] : Positions) {
+                dense.place(id, pos, Pixels.at(id).getColor());
+            }
+            for (const auto& [id, temp] : tempMap) {
+                if (dense.contains(id)) dense.setTemp(id, temp);
+            }
+            dense.rebuildFreeList();
+            Positions.clear();
+            Pixels.clear();
+            Pixels.rehash(0);
+            tempMap.clear();
+            tempMap.rehash(0);
+        } else {
+            Positions.reserve(dense.size());
+            Pixels.reserve(dense.size());
+            dense.forEach([&](size_t id, const Vec2& pos) {
+                Positions.insert(id, pos);
+                Pixels.emplace(id, GenericPixel(id, dense.color(id), pos));
+                if (const Temp* temp = dense.temp(id)) tempMap.emplace(id, *temp);
+            });
+            dense.clear();
+        }
+        denseStorage = enable;
+        return *this;
+    }
+
+    bool isDenseStorage() const {
+        return denseStorage;
+    }
+
+    /// @brief Enables the integer lattice fast path over [minx, maxx) x [miny, maxy).
+    /// @details Whole-cell positions inside the bounds are looked up through a row-major ID table,
+    /// so exact-match lookups, neighbor enumeration and frame rendering skip hashing entirely.
+    /// Positions outside the lattice still work through the sparse path.
+    /// @return Reference to self for chaining.
+    Grid2& setLattice(int minx, int miny, int maxx, int maxy) {
+        TIME_FUNCTION;
+        latticeMode = maxx > minx && maxy > miny;
+        latticeMinX = minx;
+        latticeMinY = miny;
+        latticeWidth = latticeMode ? maxx - minx : 0;
+        latticeHeight = latticeMode ? maxy - miny : 0;
+        latticeIDs.assign(latticeWidth * latticeHeight, NO_ID);
+        offLatticeCount = 0;
+        forEachPosition([&](size_t id, const Vec2& pos) {
+            latticeInsert(id, pos);
+        });
+        return *this;
+    }
 
-    //water
-    std::unordered_map<size_t, WaterParticle> water;
+    /// @brief Disables the lattice fast path and frees its table.
+    void clearLattice() {
+        latticeMode = false;
+        latticeWidth = latticeHeight = 0;
+        latticeIDs.clear();
+        latticeIDs.shrink_to_fit();
+        offLatticeCount = 0;
+    }
+
+    bool isLattice() const {
+        return latticeMode;
+    }
 
-    std::unordered_map<size_t, Temp> tempMap;
-    bool regenpreventer = false;
-public:
     /// @brief Populates the grid with Perlin noise-based pixels.
     /// @param minx Start X index.
     /// @param miny Start Y index.
@@ -285,7 +1494,7 @@ public:
     /// @param color If true, generates RGB noise. If false, generates grayscale based on alpha.
     /// @param noisemod Seed offset for the noise generator.
     /// @return Reference to self for chaining.
-    Grid2 noiseGenGrid(size_t minx,size_t miny, size_t maxx, size_t maxy, float minChance = 0.1f
+    Grid2& noiseGenGrid(size_t minx,size_t miny, size_t maxx, size_t maxy, float minChance = 0.1f
                         , float maxChance = 1.0f, bool color = true, int noisemod = 42) {
         TIME_FUNCTION;
         noisegen = PNoise2(noisemod);
@@ -294,28 +1503,7 @@ public:
                 << " max: " << maxChance << " gen colors: " << color << std::endl;
         std::vector<Vec2> poses;
         std::vector<Vec4> colors;
-        for (int x = minx; x < maxx; x++) {
-            for (int y = miny; y < maxy; y++) {
-                float nx = (x+noisemod)/(maxx+EPSILON)/0.1;
-                float ny = (y+noisemod)/(maxy+EPSILON)/0.1;
-                Vec2 pos = Vec2(nx,ny);
-                float alpha = noisegen.permute(pos);
-                if (alpha > minChance && alpha < maxChance) {
-                    if (color) {
-                        float red = noisegen.permute(Vec2(nx*0.3,ny*0.3));
-                        float green = noisegen.permute(Vec2(nx*0.6,ny*.06));
-                        float blue = noisegen.permute(Vec2(nx*0.9,ny*0.9));
-                        Vec4 newc = Vec4(red,green,blue,1.0);
-                        colors.push_back(newc);
-                        poses.push_back(Vec2(x,y));
-                    } else {
-                        Vec4 newc = Vec4(alpha,alpha,alpha,1.0);
-                        colors.push_back(newc);
-                        poses.push_back(Vec2(x,y));
-                    }
-                }
-            }
-        }
+        noiseFill(minx, miny, maxx, maxy, minChance, maxChance, color, noisemod, poses, colors, nullptr);
         std::cout << "noise generated" << std::endl;
         bulkAddObjects(poses,colors);
         return *this;
@@ -353,49 +1541,163 @@ public:
     /// @param size The size (currently unused/informational).
     /// @return The unique ID assigned to the new object.
     size_t addObject(const Vec2& pos, const Vec4& color, float size = 1.0f) {
-        size_t id = Positions.set(pos);
-        Pixels.emplace(id, GenericPixel(id, color, pos));
+        size_t id;
+        if (denseStorage) {
+            id = dense.add(pos, color);
+        } else {
+            id = Positions.set(pos);
+            Pixels.emplace(id, GenericPixel(id, color, pos));
+        }
         spatialGrid.insert(id, pos);
+        latticeInsert(id, pos);
+        invalidateNeighborCache(pos);
+        markDirty(pos);
+        growBounds(pos);
         return id;
     }
 
     /// @brief Sets the default background color.
     void setDefault(const Vec4& color) {
         defaultBackgroundColor = color;
+        invalidateRender();
     }
     
     /// @brief Sets the default background color components.
     void setDefault(float r, float g, float b, float a = 0.0f) {
         defaultBackgroundColor = Vec4(r, g, b, a);
+        invalidateRender();
     }
     
     /// @brief Configures thermal properties for a specific object ID.
+    /// @details Objects with identical properties share one MaterialTable entry.
     void setMaterialProperties(size_t id, double conductivity, double specific_heat, double density = 1.0) {
-        auto it = tempMap.at(id);
-        it.conductivity = conductivity;
-        it.specific_heat = specific_heat;
-        it.diffusivity = conductivity / (density * specific_heat);
+        setMaterial(id, materials.findOrAdd(conductivity, specific_heat, density));
+    }
+
+    /// @brief Registers a named material for use with setMaterial().
+    /// @return Material index.
+    uint16_t addMaterial(const std::string& name, float conductivity, float specificHeat, float density = 1.0f) {
+        return materials.add(name, conductivity, specificHeat, density);
+    }
+
+    /// @brief Assigns a registered material to an object that has a temperature.
+    /// @return Reference to self for chaining.
+    Grid2& setMaterial(size_t id, uint16_t material) {
+        Temp* it = findTemp(id);
+        if (!it) throw std::out_of_range("ID has no temperature");
+        if (material >= materials.size()) throw std::out_of_range("unknown material");
+        it->material = material;
+        return *this;
+    }
+
+    /// @brief Material index of an object, 0 if it has no temperature.
+    uint16_t getMaterial(size_t id) const {
+        const Temp* it = findTemp(id);
+        return it ? it->material : 0;
+    }
+
+    const MaterialTable& getMaterials() const {
+        return materials;
     }
     
     /// @brief Moves an object to a new position and updates spatial indexing.
     void setPosition(size_t id, const Vec2& newPosition) {
-        Vec2 oldPosition = Positions.at(id);
-        Pixels.at(id).move(newPosition);
+        Vec2 oldPosition = getPositionID(id);
+        invalidateNeighborCache(oldPosition);
+        markDirty(oldPosition, true);
+        markDirty(newPosition);
+        shrinkBounds(oldPosition);
+        growBounds(newPosition);
+        if (findTemp(id)) tempFieldValid = false;
+        latticeRemove(id, oldPosition);
+        latticeInsert(id, newPosition);
+        if (denseStorage) {
+            dense.position(id) = newPosition;
+        } else {
+            Pixels.at(id).move(newPosition);
+            Positions.move(id, newPosition);
+        }
         spatialGrid.update(id, oldPosition, newPosition);
-        Positions.at(id).move(newPosition);
+        invalidateNeighborCache(newPosition);
     }
         
     //set color by id (by pos same as get color)
     void setColor(size_t id, const Vec4 color) {
-        Pixels.at(id).recolor(color);
+        if (denseStorage) {
+            if (!dense.contains(id)) throw std::out_of_range("ID not found");
+            dense.color(id).recolor(color);
+        } else {
+            Pixels.at(id).recolor(color);
+        }
+        if (renderCache.valid) markDirty(positionOf(id));
     }
     
     /// @brief Sets the radius used for neighbor queries.
     /// @details Triggers an optimization of the spatial grid cell size.
     void setNeighborRadius(float radius) {
         neighborRadius = radius;
-        // updateNeighborMap(); // Recompute all neighbors
         optimizeSpatialGrid();
+        updateNeighborMap(); // Recompute all neighbors
+    }
+
+    /// @brief Enables cached neighbor lists for `neighborRadius` queries.
+    /// @details Meant for point sets that rarely move. Lists are built once in parallel; adding, removing
+    /// or moving an object only marks the lists around it as stale, and those fall back to live queries
+    /// until the next updateNeighborMap().
+    /// @return Reference to self for chaining.
+    Grid2& enableNeighborCache(bool enable = true) {
+        neighborCacheEnabled = enable;
+        if (enable) {
+            updateNeighborMap();
+        } else {
+            neighborOffsets.clear();
+            neighborOffsets.shrink_to_fit();
+            neighborIDs.clear();
+            neighborIDs.shrink_to_fit();
+            neighborDirty.clear();
+            neighborDirty.shrink_to_fit();
+            dirtyNeighborCount = 0;
+        }
+        return *this;
+    }
+
+    /// @brief Rebuilds the cached neighbor lists (CSR layout) for every object, in parallel.
+    void updateNeighborMap() {
+        if (!neighborCacheEnabled) return;
+        TIME_FUNCTION;
+        size_t slots = denseStorage ? dense.slots() : Positions.getNext_id();
+        std::vector<size_t> ids(slots);
+        std::iota(ids.begin(), ids.end(), 0);
+
+        // pass 1: count, pass 2: prefix sum into offsets, pass 3: fill
+        std::vector<size_t> counts(slots + 1, 0);
+        std::for_each(std::execution::par, ids.begin(), ids.end(), [&](size_t id) {
+            if (!hasID(id)) return;
+            size_t n = 0;
+            forEachNeighborLive(id, neighborRadius, [&](size_t) {
+                n++;
+            });
+            counts[id] = n;
+        });
+        neighborOffsets.resize(slots + 1);
+        std::exclusive_scan(std::execution::par, counts.begin(), counts.end(), neighborOffsets.begin(), size_t(0));
+        neighborIDs.resize(neighborOffsets[slots]);
+        std::for_each(std::execution::par, ids.begin(), ids.end(), [&](size_t id) {
+            if (!hasID(id)) return;
+            size_t out = neighborOffsets[id];
+            forEachNeighborLive(id, neighborRadius, [&](size_t neighborId) {
+                neighborIDs[out++] = neighborId;
+            });
+        });
+
+        neighborDirty.assign(slots, 0);
+        dirtyNeighborCount = 0;
+        cachedNeighborRadius = neighborRadius;
+    }
+
+    /// @brief Number of objects whose cached neighbor list is stale.
+    size_t getDirtyNeighborCount() const {
+        return dirtyNeighborCount;
     }
     
     /// @brief Sets the temperature at a specific position (creates point if missing).
@@ -407,7 +1709,9 @@ public:
     /// @brief Sets the temperature for a specific object ID.
     void setTemp(size_t id, double temp) {
         Temp tval = Temp(temp);
-        tempMap.emplace(id, tval);
+        if (const Temp* existing = findTemp(id)) tval.material = existing->material;
+        storeTemp(id, tval);
+        if (renderCache.valid) markDirty(getPositionID(id));
     }
     
     // Get current default background color
@@ -417,6 +1721,10 @@ public:
 
     //get position from id
     Vec2 getPositionID(size_t id) const {
+        if (denseStorage) {
+            if (!dense.contains(id)) throw std::out_of_range("ID not found");
+            return dense.position(id);
+        }
         Vec2 it = Positions.at(id);
         return it;
     }
@@ -429,16 +1737,16 @@ public:
     size_t getPositionVec(const Vec2& pos, float radius = 0.0f) const {
         TIME_FUNCTION;
         if (radius == 0.0f) {
-            // Exact match - use spatial grid to find the cell
-            Vec2 gridPos = spatialGrid.worldToGrid(pos);
-            auto cellIt = spatialGrid.grid.find(gridPos);
-            if (cellIt != spatialGrid.grid.end()) {
-                for (size_t id : cellIt->second) {
-                    if (Positions.at(id) == pos) {
-                        return id;
-                    }
-                }
+            size_t index;
+            if (latticeIndex(pos, index)) {
+                if (latticeIDs[index] != NO_ID) return latticeIDs[index];
+                if (offLatticeCount == 0) throw std::out_of_range("Position not found");
             }
+            // Exact match - use spatial grid to find the cell
+            size_t id = spatialGrid.findInCell(pos, [&](size_t candidateId) {
+                return positionOf(candidateId) == pos;
+            });
+            if (id != NO_ID) return id;
             throw std::out_of_range("Position not found");
         } else {
             auto results = getPositionVecRegion(pos, radius);
@@ -457,14 +1765,14 @@ public:
     size_t getOrCreatePositionVec(const Vec2& pos, float radius = 0.0f, bool create = true) {
         //TIME_FUNCTION; //called too many times and average time is less than 0.0000001 so ignore it.
         if (radius == 0.0f) {
-            Vec2 gridPos = spatialGrid.worldToGrid(pos);
-            auto cellIt = spatialGrid.grid.find(gridPos);
-            if (cellIt != spatialGrid.grid.end()) {
-                for (size_t id : cellIt->second) {
-                    if (Positions.at(id) == pos) {
-                        return id;
-                    }
-                }
+            size_t index;
+            bool onLattice = latticeIndex(pos, index);
+            if (onLattice && latticeIDs[index] != NO_ID) return latticeIDs[index];
+            if (!onLattice || offLatticeCount > 0) {
+                size_t id = spatialGrid.findInCell(pos, [&](size_t candidateId) {
+                    return positionOf(candidateId) == pos;
+                });
+                if (id != NO_ID) return id;
             }
             if (create) {
 
@@ -486,97 +1794,142 @@ public:
     /// @brief Returns a list of all object IDs within a specified radius of a position.
     std::vector<size_t> getPositionVecRegion(const Vec2& pos, float radius = 1.0f) const {
         //TIME_FUNCTION;
-        float searchRadius = (radius == 0.0f) ? std::numeric_limits<float>::epsilon() : radius;
-        
-        // Get candidates from spatial grid
-        std::vector<size_t> candidates = spatialGrid.queryRange(pos, searchRadius);
-        
-        // Fine-filter by exact distance
         std::vector<size_t> results;
+        forEachInRadius(pos, radius, [&](size_t id) {
+            results.push_back(id);
+        });
+        return results;
+    }
+
+    /// @brief Calls fn(id) for every object within radius of a position, without building a container.
+    /// @param radius If 0.0, only objects exactly at pos are visited.
+    template<typename Func>
+    void forEachInRadius(const Vec2& pos, float radius, Func&& fn) const {
+        float searchRadius = (radius == 0.0f) ? std::numeric_limits<float>::epsilon() : radius;
+        if (forEachLatticeNeighbor(pos, searchRadius, [&](size_t id, const Vec2&) {
+            fn(id);
+        })) {
+            return;
+        }
+        // Get candidates from spatial grid and fine-filter by exact distance
         float radiusSq = searchRadius * searchRadius;
-        
-        for (size_t id : candidates) {
-            if (Positions.at(id).distanceSquared(pos) <= radiusSq) {
-                results.push_back(id);
+        spatialGrid.forEachInRange(pos, searchRadius, [&](size_t id) {
+            if (positionOf(id).distanceSquared(pos) <= radiusSq) {
+                fn(id);
+            }
+        });
+    }
+
+    /// @brief Calls fn(neighborId) for every object within radius of the given ID, excluding the ID itself.
+    /// @details Candidates are filtered in place, nothing is allocated. The functor must not add, remove or move objects.
+    template<typename Func>
+    void forEachNeighbor(size_t id, float radius, Func&& fn) const {
+        if (neighborCacheEnabled && radius == cachedNeighborRadius &&
+            id < neighborDirty.size() && !neighborDirty[id]) {
+            for (size_t i = neighborOffsets[id]; i < neighborOffsets[id + 1]; ++i) {
+                fn(neighborIDs[i]);
             }
+            return;
         }
-        
-        return results;
+        forEachNeighborLive(id, radius, fn);
+    }
+
+    /// @brief Calls fn(neighborId) for every object within `neighborRadius` of the given ID.
+    template<typename Func>
+    void forEachNeighbor(size_t id, Func&& fn) const {
+        forEachNeighbor(id, neighborRadius, fn);
     }
     
     Vec4 getColor(size_t id) {
+        if (denseStorage) {
+            if (!dense.contains(id)) throw std::out_of_range("ID not found");
+            return dense.color(id);
+        }
         return Pixels.at(id).getColor();
     }
     
     /// @brief Gets the temperature of a specific ID. Lazily initializes temperature if missing.
     float getTemp(size_t id) {
-        if (tempMap.find(id) != tempMap.end()) {
-            Temp temp = Temp(getPositionID(id), getTemps());
-            tempMap.emplace(id, temp);
+        if (const Temp* found = findTemp(id)) {
+            return found->temp;
         }
-        else {
-            std::cout << "found a temp: " << tempMap.at(id).temp << std::endl;
-        }
-        return tempMap.at(id).temp;
+        Temp temp = Temp(temperatureField().idw(getPositionID(id)));
+        storeInterpolatedTemp(id, temp);
+        return temp.temp;
     }
     
     /// @brief Gets the temperature at a position. Interpolates (IDW) if necessary.
     double getTemp(const Vec2 pos) {
         size_t id = getOrCreatePositionVec(pos, 0.01f, true);
-        if (tempMap.find(id) == tempMap.end()) {
+        const Temp* found = findTemp(id);
+        if (!found) {
             //std::cout << "missing a temp at: " << pos << std::endl;
-            double dtemp = Temp::calTempIDW(pos, getTemps(id));
-            setTemp(id, dtemp);
+            double dtemp = temperatureField().idw(pos);
+            storeInterpolatedTemp(id, Temp(dtemp));
             return dtemp;
         }
-        else return tempMap.at(id).temp;
+        else return found->temp;
+    }
+
+    /// @brief Interpolated temperatures at many positions at once (k-nearest IDW over all samples, in parallel).
+    /// @details Unlike getTemp(Vec2) this never creates objects, so it is suited to sampling whole frames.
+    std::vector<float> sampleTemps(const std::vector<Vec2>& positions, size_t k = 8) {
+        return temperatureField().idwBatch(positions, k);
     }
 
     /// @brief Retrieves all temperatures in the grid mapped by position.
     std::unordered_map<Vec2, Temp> getTemps() const {
         std::unordered_map<Vec2, Temp> out;
-        for (const auto& [id, temp] : tempMap) {
+        const_cast<Grid2*>(this)->forEachTemp([&](size_t id, const Temp& temp) {
             out.emplace(getPositionID(id), temp);
-        }
+        });
         return out;
     }
 
     /// @brief Retrieves temperatures of neighbors around a specific ID.
     std::unordered_map<Vec2, Temp> getTemps(size_t id) const {
         std::unordered_map<Vec2, Temp> out;
-        std::vector<size_t> tval = spatialGrid.queryRange(Positions.at(id), 10);
-        for (size_t tempid : tval) {
-            Vec2 pos = Positions.at(tempid);
-            if (tempMap.find(id) != tempMap.end()) {
-                Temp temp = tempMap.at(tempid);
-                out.insert({pos, temp});
+        spatialGrid.forEachInRange(getPositionID(id), 10, [&](size_t tempid) {
+            if (const Temp* temp = findTemp(tempid)) {
+                out.insert({getPositionID(tempid), *temp});
             }
-        }
+        });
         return out;
     }
 
-    /// @brief Calculates the axis-aligned bounding box of all objects in the grid.
+    /// @brief Returns the axis-aligned bounding box of all objects in the grid.
+    /// @details The box is kept up to date on insert and move; a full scan only happens after a point on the
+    /// boundary was removed or moved inward.
     void getBoundingBox(Vec2& minCorner, Vec2& maxCorner) const {
-        TIME_FUNCTION;
-        if (Positions.empty()) {
+        if (denseStorage ? dense.empty() : Positions.empty()) {
             minCorner = Vec2(0, 0);
             maxCorner = Vec2(0, 0);
             return;
         }
-        
-        // Initialize with first position
-        auto it = Positions.begin();
-        minCorner = it->second;
-        maxCorner = it->second;
+        if (!boundsValid) {
+            computeBoundingBox(boundsMin, boundsMax);
+            boundsValid = true;
+        }
+        minCorner = boundsMin;
+        maxCorner = boundsMax;
+    }
+
+    /// @brief Scans every object for the axis-aligned bounding box.
+    void computeBoundingBox(Vec2& minCorner, Vec2& maxCorner) const {
+        TIME_FUNCTION;
+
+        // Initialize with extreme values so the first position sets both corners
+        minCorner = Vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+        maxCorner = Vec2(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
         
         // Find min and max coordinates
         //#pragma omp parallel for
-        for (const auto& [id, pos] : Positions) {
+        forEachPosition([&](size_t, const Vec2& pos) {
             minCorner.x = std::min(minCorner.x, pos.x);
             minCorner.y = std::min(minCorner.y, pos.y);
             maxCorner.x = std::max(maxCorner.x, pos.x);
             maxCorner.y = std::max(maxCorner.y, pos.y);
-        }
+        });
         
     }
 
@@ -589,115 +1942,97 @@ public:
     frame getGridRegionAsFrame(const Vec2& minCorner, const Vec2& maxCorner,
                        Vec2& res, frame::colormap outChannels = frame::colormap::RGB)  {
         TIME_FUNCTION;
-        size_t width = static_cast<int>(maxCorner.x - minCorner.x);
-        size_t height = static_cast<int>(maxCorner.y - minCorner.y);
+        int width = static_cast<int>(maxCorner.x - minCorner.x);
+        int height = static_cast<int>(maxCorner.y - minCorner.y);
         size_t outputWidth = static_cast<int>(res.x);
         size_t outputHeight = static_cast<int>(res.y);
-        float widthScale = outputWidth / width;
-        float heightScale = outputHeight / height;
-        
+
         frame outframe = frame();
         outframe.colorFormat = outChannels;
 
-        if (width <= 0 || height <= 0) {
-            width = height = 0;
+        if (width <= 0 || height <= 0 || outputWidth == 0 || outputHeight == 0) {
             return outframe;
         }
         if (regenpreventer) return outframe;
         else regenpreventer = true;
 
+        // points on maxCorner land one past the last pixel and are clamped back onto it
+        float widthScale = outputWidth / static_cast<float>(width);
+        float heightScale = outputHeight / static_cast<float>(height);
+
         std::cout << "Rendering region: " << minCorner << " to " << maxCorner 
                 << " at resolution: " << res << std::endl;
         std::cout << "Scale factors: " << widthScale << " x " << heightScale << std::endl;
-        
-        std::unordered_map<Vec2,Vec4> colorBuffer;
-        colorBuffer.reserve(outputHeight*outputWidth);
-        std::unordered_map<Vec2,Vec4> colorTempBuffer;
-        colorTempBuffer.reserve(outputHeight * outputWidth);
-        std::unordered_map<Vec2,int> countBuffer;
-        countBuffer.reserve(outputHeight * outputWidth);
-        std::cout << "built buffers" << std::endl;
-
-        for (const auto& [id, pos] : Positions) {
-            if (pos.x >= minCorner.x && pos.x <= maxCorner.x && 
-                pos.y >= minCorner.y && pos.y <= maxCorner.y) {
-                float relx = pos.x - minCorner.x;
-                float rely = pos.y - minCorner.y;
-                int pixx = static_cast<int>(relx * widthScale);
-                int pixy = static_cast<int>(rely * heightScale);
-                Vec2 pix = Vec2(pixx,pixy);
-                
-                colorTempBuffer[pix] += Pixels.at(id).getColor();
-                countBuffer[pix]++;
-            }
-        }
-        std::cout << std::endl << "built initial buffer" << std::endl;
 
-        for (size_t y = 0; y < outputHeight; ++y) {
-            for (size_t x = 0; x < outputWidth; ++x) {
-                if (countBuffer[Vec2(x,y)] > 0) colorBuffer[Vec2(x,y)] = colorTempBuffer[Vec2(x,y)] / static_cast<float>(countBuffer[Vec2(x,y)]) * 255;
-                else colorBuffer[Vec2(x,y)] = defaultBackgroundColor;
-            }
-        }
-        std::cout << "blended second buffer" << std::endl;
-
-        switch (outChannels) {
-            case frame::colormap::RGBA: {
-                std::vector<uint8_t> colorBuffer2(outputWidth*outputHeight*4, 0);
-                std::cout << "outputting RGBA: " << std::endl;
-                for (const auto& [v2,getColor] : colorBuffer) {
-                    size_t index = (v2.y * outputWidth + v2.x) * 4;
-                    // std::cout << "index: " << index << std::endl;
-                    colorBuffer2[index+0] = getColor.r;
-                    colorBuffer2[index+1] = getColor.g;
-                    colorBuffer2[index+2] = getColor.b;
-                    colorBuffer2[index+3] = getColor.a;
-                }
-                frame result = frame(res.x,res.y, frame::colormap::RGBA);
-                result.setData(colorBuffer2);
-                std::cout << "returning result" << std::endl;
-                regenpreventer = false;
-                return result;
-                break;
-            }
-            case frame::colormap::BGR: {
-                std::vector<uint8_t> colorBuffer2(outputWidth*outputHeight*3, 0);
-                std::cout << "outputting BGR: " << std::endl;
-                for (const auto& [v2,getColor] : colorBuffer) {
-                    size_t index = (v2.y * outputWidth + v2.x) * 3;
-                    // std::cout << "index: " << index << std::endl;
-                    colorBuffer2[index+2] = getColor.r;
-                    colorBuffer2[index+1] = getColor.g;
-                    colorBuffer2[index+0] = getColor.b;
-                    //colorBuffer2[index+3] = getColor.a;
+        RegionRaster raster(minCorner, maxCorner, outputWidth, outputHeight, widthScale, heightScale);
+        std::vector<Vec4> colorSum(outputWidth * outputHeight, Vec4(0, 0, 0, 0));
+        std::vector<uint32_t> countBuffer(outputWidth * outputHeight, 0);
+        auto colorOf = [&](size_t id) {
+            return denseStorage ? dense.color(id) : Pixels.at(id).getColor();
+        };
+
+        if (latticeOnly()) {
+            // each tile pulls the lattice cells under it, so tiles never share output pixels
+            std::for_each(std::execution::par, raster.tiles.begin(), raster.tiles.end(), [&](size_t tile) {
+                Vec2 tileMin, tileMax;
+                raster.tileWorldBounds(tile, tileMin, tileMax);
+                forEachLatticeInRegion(tileMin, tileMax, [&](size_t id, const Vec2& pos) {
+                    size_t pixel;
+                    if (raster.pixelOf(pos, pixel) && raster.tileOf(pixel) == tile) {
+                        colorSum[pixel] += colorOf(id);
+                        countBuffer[pixel]++;
+                    }
+                });
+            });
+        } else {
+            // bin every visible point by tile (counting sort), then accumulate the tiles in parallel
+            std::vector<std::pair<uint32_t, size_t>> binned;
+            std::vector<size_t> tileStart(raster.tiles.size() + 1, 0);
+            forEachPosition([&](size_t id, const Vec2& pos) {
+                size_t pixel;
+                if (raster.pixelOf(pos, pixel)) {
+                    binned.emplace_back(static_cast<uint32_t>(pixel), id);
+                    tileStart[raster.tileOf(pixel) + 1]++;
                 }
-                frame result = frame(res.x,res.y, frame::colormap::BGR);
-                result.setData(colorBuffer2);
-                std::cout << "returning result" << std::endl;
-                regenpreventer = false;
-                return result;
-                break;
+            });
+            std::inclusive_scan(tileStart.begin(), tileStart.end(), tileStart.begin());
+            std::vector<std::pair<uint32_t, size_t>> sorted(binned.size());
+            std::vector<size_t> cursor(tileStart.begin(), tileStart.end() - 1);
+            for (const auto& entry : binned) {
+                sorted[cursor[raster.tileOf(entry.first)]++] = entry;
             }
-            case frame::colormap::RGB: 
-            default: {
-                std::vector<uint8_t> colorBuffer2(outputWidth*outputHeight*3, 0);
-                std::cout << "outputting RGB: " << std::endl;
-                for (const auto& [v2,getColor] : colorBuffer) {
-                    size_t index = (v2.y * outputWidth + v2.x) * 3;
-                    // std::cout << "index: " << index << std::endl;
-                    colorBuffer2[index+0] = getColor.r;
-                    colorBuffer2[index+1] = getColor.g;
-                    colorBuffer2[index+2] = getColor.b;
-                    //colorBuffer2[index+3] = getColor.a;
+            std::for_each(std::execution::par, raster.tiles.begin(), raster.tiles.end(), [&](size_t tile) {
+                for (size_t i = tileStart[tile]; i < tileStart[tile + 1]; ++i) {
+                    colorSum[sorted[i].first] += colorOf(sorted[i].second);
+                    countBuffer[sorted[i].first]++;
                 }
-                frame result = frame(res.x,res.y, frame::colormap::RGB);
-                result.setData(colorBuffer2);
-                std::cout << "returning result" << std::endl;
-                regenpreventer = false;
-                return result;
-                break;
+            });
+        }
+        // water is not in the object set, so blend it in from the solver's positions
+        for (size_t i = 0; i < waterSolver.size(); ++i) {
+            size_t pixel;
+            if (raster.pixelOf(waterSolver.positions[i], pixel)) {
+                colorSum[pixel] += waterColors[waterSolver.ids[i]];
+                countBuffer[pixel]++;
             }
         }
+
+        // resolve straight into the requested channel layout
+        size_t channels = frameChannels(outChannels);
+        std::vector<uint8_t> pixels(outputWidth * outputHeight * channels);
+        std::for_each(std::execution::par, raster.tiles.begin(), raster.tiles.end(), [&](size_t tile) {
+            raster.forEachPixel(tile, [&](size_t pixel) {
+                Vec4 color = countBuffer[pixel] > 0
+                    ? colorSum[pixel] / static_cast<float>(countBuffer[pixel]) * 255
+                    : defaultBackgroundColor;
+                writePixel(pixels.data() + pixel * channels, color, outChannels);
+            });
+        });
+
+        frame result = frame(res.x, res.y, outChannels);
+        result.setData(std::move(pixels));
+        regenpreventer = false;
+        return result;
     }
 
     /// @brief Renders the entire grid into a Frame. Auto-calculates bounds.
@@ -710,92 +2045,160 @@ public:
         return getGridRegionAsFrame(min, max, res, outchannel);
     }
 
-    /// @brief Generates a heatmap visualization of the grid temperatures.
+    /// @brief Renders the entire grid like getGridAsFrame(), but keeps the frame between calls.
+    /// @details Later calls only redraw the pixels of objects that were added, removed, moved, recolored or
+    /// given a temperature since the previous call, so the cost follows the amount of change rather than the
+    /// grid size. Falls back to a full render when the bounds or the background change or after bulk edits.
+    /// @return The cached frame; copy it to keep a snapshot.
+    const frame& getGridAsFrameIncremental(frame::colormap outchannel = frame::colormap::RGB) {
+        TIME_FUNCTION;
+        if (renderCache.valid && renderCache.format == outchannel) {
+            for (const Vec2& pos : renderCache.dirty) {
+                if (pos.x < renderCache.minCorner.x || pos.y < renderCache.minCorner.y ||
+                    pos.x > renderCache.maxCorner.x || pos.y > renderCache.maxCorner.y) {
+                    invalidateRender();
+                    break;
+                }
+            }
+        }
+        if (!renderCache.valid || renderCache.format != outchannel) {
+            Vec2 min;
+            Vec2 max;
+            getBoundingBox(min, max);
+            Vec2 res = (max + 1) - min;
+            frame image = getGridRegionAsFrame(min, max, res, outchannel);
+            renderCache.valid = !image.getData().empty();
+            renderCache.format = outchannel;
+            renderCache.minCorner = min;
+            renderCache.maxCorner = max;
+            renderCache.scaleX = res.x / static_cast<int>(max.x - min.x);
+            renderCache.scaleY = res.y / static_cast<int>(max.y - min.y);
+            renderCache.image = std::move(image);
+            renderCache.dirty.clear();
+            return renderCache.image;
+        }
+
+        RegionRaster raster(renderCache.minCorner, renderCache.maxCorner, renderCache.image.getWidth(),
+                            renderCache.image.getHeight(), renderCache.scaleX, renderCache.scaleY);
+        std::vector<size_t> pixels;
+        pixels.reserve(renderCache.dirty.size());
+        for (const Vec2& pos : renderCache.dirty) {
+            size_t pixel;
+            if (raster.pixelOf(pos, pixel)) pixels.push_back(pixel);
+        }
+        std::sort(pixels.begin(), pixels.end());
+        pixels.erase(std::unique(pixels.begin(), pixels.end()), pixels.end());
+
+        size_t channels = frameChannels(outchannel);
+        uint8_t* out = renderCache.image.mutableData().data();
+        std::for_each(std::execution::par, pixels.begin(), pixels.end(), [&](size_t pixel) {
+            redrawPixel(raster, pixel, out + pixel * channels);
+        });
+        renderCache.dirty.clear();
+        return renderCache.image;
+    }
+
+    /// @brief Renders temperatures over a region as a heatmap, normalised to the region's min and max.
+    /// @details Lattice cells are read straight from temperature storage; any sample that misses a cell
+    /// falls back to the interpolated temperature field. Nothing is added to the grid.
     frame getTempAsFrame(Vec2 minCorner, Vec2 maxCorner, Vec2 res, frame::colormap outcolor = frame::colormap::RGB)  {
         TIME_FUNCTION;
         if (regenpreventer) return frame();
         else regenpreventer = true;
-        int pcount = 0;
-        size_t sheight = maxCorner.x - minCorner.x;
-        size_t swidth = maxCorner.y - minCorner.y;
-        
-        int width = static_cast<int>(res.x);
-        int height = static_cast<int>(res.y);
-        std::unordered_map<Vec2, double> tempBuffer;
-        tempBuffer.reserve(res.x * res.y);
-        double maxTemp = 0.0;
-        double minTemp = 0.0;
-        float xdiff = (maxCorner.x - minCorner.x);
-        float ydiff = (maxCorner.y - minCorner.y);
-        for (int x = 0; x < res.x; x++) {
-            for (int y = 0; y < res.y; y++) {
-                Vec2 cposout = Vec2(x,y);
-                Vec2 cposin = Vec2(minCorner.x + (x * xdiff / res.x),minCorner.y + (y * ydiff / res.y));
-                double ctemp = getTemp(cposin);
-                
-                tempBuffer[Vec2(x,y)] = ctemp;
-                if (ctemp > maxTemp) maxTemp = ctemp;
-                else if (ctemp < minTemp) minTemp = ctemp;
+        size_t width = static_cast<size_t>(res.x);
+        size_t height = static_cast<size_t>(res.y);
+        size_t channels = frameChannels(outcolor);
+        float xstep = (maxCorner.x - minCorner.x) / res.x;
+        float ystep = (maxCorner.y - minCorner.y) / res.y;
+        std::vector<size_t> rows(height);
+        std::iota(rows.begin(), rows.end(), 0);
+
+        //pass 1: direct reads from storage, NaN marks samples that need interpolating
+        std::vector<float> samples(width * height, std::numeric_limits<float>::quiet_NaN());
+        std::atomic<size_t> misses = 0;
+        bool direct = latticeOnly();
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+            float* row = samples.data() + y * width;
+            size_t rowMisses = 0;
+            for (size_t x = 0; x < width; ++x) {
+                Vec2 pos(minCorner.x + x * xstep, minCorner.y + y * ystep);
+                size_t index;
+                if (direct && latticeIndex(pos, index) && latticeIDs[index] != NO_ID) {
+                    if (const Temp* temp = findTemp(latticeIDs[index])) {
+                        row[x] = temp->temp;
+                        continue;
+                    }
+                }
+                rowMisses++;
             }
+            misses += rowMisses;
+        });
+
+        //pass 2: interpolate whatever storage could not answer
+        if (misses > 0 && tempCount() > 0) {
+            const TempField& field = temperatureField();
+            std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+                float* row = samples.data() + y * width;
+                for (size_t x = 0; x < width; ++x) {
+                    if (std::isnan(row[x])) row[x] = field.idw(Vec2(minCorner.x + x * xstep, minCorner.y + y * ystep));
+                }
+            });
+        } else if (misses > 0) {
+            std::fill(samples.begin(), samples.end(), 0.0f);
         }
+
+        auto [minIt, maxIt] = std::minmax_element(std::execution::par, samples.begin(), samples.end());
+        float minTemp = samples.empty() ? 0.0f : *minIt;
+        float maxTemp = samples.empty() ? 0.0f : *maxIt;
         std::cout << "max temp: " << maxTemp << " min temp: " << minTemp << std::endl;
-        
-        switch (outcolor) {
-            case frame::colormap::RGBA: {
-                std::vector<uint8_t> rgbaBuffer(width*height*4, 0);
-                for (const auto& [v2, temp] : tempBuffer) {
-                    size_t index = (v2.y * width + v2.x) * 4;
-                    uint8_t atemp  = static_cast<unsigned char>((((temp-minTemp)) / (maxTemp-minTemp)) * 255);
-                    rgbaBuffer[index+0] = atemp;
-                    rgbaBuffer[index+1] = atemp;
-                    rgbaBuffer[index+2] = atemp;
-                    rgbaBuffer[index+3] = 255;
-                }
-                frame result = frame(res.x,res.y, frame::colormap::RGBA);
-                result.setData(rgbaBuffer);
-                regenpreventer = false;
-                return result;
-                break;
-            }
-            case frame::colormap::BGR: {
-                std::vector<uint8_t> rgbaBuffer(width*height*3, 0);
-                for (const auto& [v2, temp] : tempBuffer) {
-                    size_t index = (v2.y * width + v2.x) * 3;
-                    uint8_t atemp  = static_cast<unsigned char>((((temp-minTemp)) / (maxTemp-minTemp)) * 255);
-                    rgbaBuffer[index+2] = atemp;
-                    rgbaBuffer[index+1] = atemp;
-                    rgbaBuffer[index+0] = atemp;
+
+        //256 entry colormap, pre-encoded in the output channel order
+        std::vector<uint8_t> lut(256 * channels);
+        for (size_t i = 0; i < 256; ++i) {
+            writePixel(lut.data() + i * channels, heatColor(i / 255.0f) * 255.0f, outcolor);
+        }
+
+        float scale = maxTemp > minTemp ? 255.0f / (maxTemp - minTemp) : 0.0f;
+        std::vector<uint8_t> pixels(width * height * channels);
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+            const float* row = samples.data() + y * width;
+            uint8_t levels[256];
+            uint8_t* out = pixels.data() + y * width * channels;
+            for (size_t x0 = 0; x0 < width; x0 += 256) {
+                size_t count = std::min<size_t>(256, width - x0);
+                //branch free quantisation so the compiler can vectorise it
+                for (size_t i = 0; i < count; ++i) {
+                    float level = (row[x0 + i] - minTemp) * scale;
+                    levels[i] = static_cast<uint8_t>(std::clamp(level, 0.0f, 255.0f));
                 }
-                frame result = frame(res.x,res.y, frame::colormap::BGR);
-                result.setData(rgbaBuffer);
-                regenpreventer = false;
-                return result;
-                break;
-            }
-            case frame::colormap::RGB: 
-            default: {
-                std::vector<uint8_t> rgbaBuffer(width*height*3, 0);
-                for (const auto& [v2, temp] : tempBuffer) {
-                    size_t index = (v2.y * width + v2.x) * 3;
-                    uint8_t atemp  = static_cast<unsigned char>((((temp-minTemp)) / (maxTemp-minTemp)) * 255);
-                    rgbaBuffer[index+0] = atemp;
-                    rgbaBuffer[index+1] = atemp;
-                    rgbaBuffer[index+2] = atemp;
+                for (size_t i = 0; i < count; ++i) {
+                    std::memcpy(out + (x0 + i) * channels, lut.data() + levels[i] * channels, channels);
                 }
-                frame result = frame(res.x,res.y, frame::colormap::RGB);
-                result.setData(rgbaBuffer);
-                regenpreventer = false;
-                return result;
-                break;
             }
-        }
+        });
+
+        frame result = frame(width, height, outcolor);
+        result.setData(std::move(pixels));
+        regenpreventer = false;
+        return result;
     }
 
     /// @brief Removes an object from the grid entirely.
     size_t removeID(size_t id) {
-        Vec2 oldPosition = Positions.at(id);
+        Vec2 oldPosition = getPositionID(id);
+        invalidateNeighborCache(oldPosition);
+        markDirty(oldPosition, true);
+        shrinkBounds(oldPosition);
+        if (findTemp(id)) tempFieldValid = false;
+        latticeRemove(id, oldPosition);
+        if (denseStorage) {
+            dense.remove(id);
+            spatialGrid.remove(id, oldPosition);
+            return id;
+        }
         Positions.remove(id);
         Pixels.erase(id);
+        tempMap.erase(id);
         unassignedIDs.push_back(id);
         spatialGrid.remove(id, oldPosition);
         return id;
@@ -805,65 +2208,28 @@ public:
     void bulkUpdatePositions(const std::unordered_map<size_t, Vec2>& newPositions) {
         TIME_FUNCTION;
         for (const auto& [id, newPos] : newPositions) {
-            Vec2 oldPosition = Positions.at(id);
-            Positions.at(id).move(newPos);
-            Pixels.at(id).move(newPos);
-            spatialGrid.update(id, oldPosition, newPos);
+            setPosition(id, newPos);
         }
     }
     
     /// @brief Batch insertion of objects for efficiency.
+    /// @details Points are sorted by spatial cell and get consecutive IDs in that order, so neighbors end up
+    /// close together in memory. In dense mode the storage and spatial index are filled in parallel; the
+    /// hash maps of the default mode are filled serially and only the spatial index is built in parallel.
+    /// Freed dense slots are not reused by a bulk insert.
+    /// @return The ID of each input point, in input order.
     std::vector<size_t> bulkAddObjects(const std::vector<Vec2> poses, std::vector<Vec4> colors) {
         TIME_FUNCTION;
-        std::vector<size_t> ids;
-        ids.reserve(poses.size());
-        
-        // Reserve space in maps to avoid rehashing
-        if (Positions.bucket_count() < Positions.size() + poses.size()) {
-            Positions.reserve(Positions.size() + poses.size());
-            Pixels.reserve(Positions.size() + poses.size());
-        }
-        
-        // Batch insertion
-        std::vector<size_t> newids;
-        for (size_t i = 0; i < poses.size(); ++i) {
-            size_t id = Positions.set(poses[i]);
-            Pixels.emplace(id, GenericPixel(id, colors[i], poses[i]));
-            spatialGrid.insert(id,poses[i]);
-            newids.push_back(id);
-        }
-        
+        std::vector<size_t> newids = insertBatch(poses, colors, nullptr);
         shrinkIfNeeded();
-        
         return newids;
     }
 
     /// @brief Batch insertion of objects including temperature data.
     std::vector<size_t> bulkAddObjects(const std::vector<Vec2> poses, std::vector<Vec4> colors, std::vector<float>& temps) {
         TIME_FUNCTION;
-        std::vector<size_t> ids;
-        ids.reserve(poses.size());
-        
-        // Reserve space in maps to avoid rehashing
-        if (Positions.bucket_count() < Positions.size() + poses.size()) {
-            Positions.reserve(Positions.size() + poses.size());
-            Pixels.reserve(Positions.size() + poses.size());
-            tempMap.reserve(tempMap.size() + temps.size());
-        }
-        
-        // Batch insertion
-        std::vector<size_t> newids;
-        for (size_t i = 0; i < poses.size(); ++i) {
-            size_t id = Positions.set(poses[i]);
-            Pixels.emplace(id, GenericPixel(id, colors[i], poses[i]));
-            Temp temptemp = Temp(temps[i]);
-            tempMap.insert({id, temptemp});
-            spatialGrid.insert(id,poses[i]);
-            newids.push_back(id);
-        }
-        
+        std::vector<size_t> newids = insertBatch(poses, colors, &temps);
         shrinkIfNeeded();
-        
         return newids;
     }
 
@@ -875,7 +2241,20 @@ public:
     void clear() {
         Positions.clear();
         Pixels.clear();
+        tempMap.clear();
+        water.clear();
+        waterColors.clear();
+        waterSlots.clear();
+        waterSolver.clear();
+        dense.clear();
         spatialGrid.clear();
+        if (latticeMode) std::fill(latticeIDs.begin(), latticeIDs.end(), NO_ID);
+        offLatticeCount = 0;
+        if (neighborCacheEnabled) updateNeighborMap();
+        invalidateRender();
+        boundsValid = false;
+        tempFieldValid = false;
+        tempField.clear();
         Pixels.rehash(0);
         defaultBackgroundColor = Vec4(0.0f, 0.0f, 0.0f, 0.0f);
     }
@@ -888,48 +2267,33 @@ public:
         
         // Rebuild spatial grid
         spatialGrid.clear();
-        for (const auto& [id, pos] : Positions) {
+        size_t objects = denseStorage ? dense.size() : Positions.size();
+        spatialGrid.reserve(objects, denseStorage ? dense.slots() : Positions.getNext_id());
+        forEachPosition([&](size_t id, const Vec2& pos) {
             spatialGrid.insert(id, pos);
-        }
+        });
     }
 
     /// @brief Gets IDs of objects within `neighborRadius` of the given ID.
     std::vector<size_t> getNeighbors(size_t id) const {
-        Vec2 pos = Positions.at(id);
-        std::vector<size_t> candidates = spatialGrid.queryRange(pos, neighborRadius);
-        
         std::vector<size_t> neighbors;
-        float radiusSq = neighborRadius * neighborRadius;
-        
-        for (size_t candidateId : candidates) {
-            if (candidateId != id && pos.distanceSquared(Positions.at(candidateId)) <= radiusSq) {
-                neighbors.push_back(candidateId);
-            }
-        }
-        
+        forEachNeighbor(id, neighborRadius, [&](size_t neighborId) {
+            neighbors.push_back(neighborId);
+        });
         return neighbors;
     }
     
     /// @brief Gets IDs of objects within a custom distance of the given ID.
     std::vector<size_t> getNeighborsRange(size_t id, float dist) const {
-        Vec2 pos = Positions.at(id);
-        std::vector<size_t> candidates = spatialGrid.queryRange(pos, neighborRadius);
-        
         std::vector<size_t> neighbors;
-        float radiusSq = dist * dist;
-        
-        for (size_t candidateId : candidates) {
-            if (candidateId != id && 
-                pos.distanceSquared(Positions.at(candidateId)) <= radiusSq) {
-                neighbors.push_back(candidateId);
-            }
-        }
-        
+        forEachNeighbor(id, dist, [&](size_t neighborId) {
+            neighbors.push_back(neighborId);
+        });
         return neighbors;
     }
     
     /// @brief Generates a noise grid that includes temperature data.
-    Grid2 noiseGenGridTemps(size_t minx,size_t miny, size_t maxx, size_t maxy, float minChance = 0.1f
+    Grid2& noiseGenGridTemps(size_t minx,size_t miny, size_t maxx, size_t maxy, float minChance = 0.1f
                         , float maxChance = 1.0f, bool color = true, int noisemod = 42) {
         TIME_FUNCTION;
         noisegen = PNoise2(noisemod);
@@ -939,53 +2303,50 @@ public:
         std::vector<Vec2> poses;
         std::vector<Vec4> colors;
         std::vector<float> temps;
-        int callnumber = 0;
-        for (int x = minx; x < maxx; x++) {
-            for (int y = miny; y < maxy; y++) {
-                float nx = (x+noisemod)/(maxx+EPSILON)/0.1;
-                float ny = (y+noisemod)/(maxy+EPSILON)/0.1;
-                Vec2 pos = Vec2(nx,ny);
-                float temp = noisegen.permute(Vec2(nx*0.2+1,ny*0.1+2));
-                float alpha = noisegen.permute(pos);
-                if (alpha > minChance && alpha < maxChance) {
-                    if (color) {
-                        float red = noisegen.permute(Vec2(nx*0.3,ny*0.3));
-                        float green = noisegen.permute(Vec2(nx*0.6,ny*.06));
-                        float blue = noisegen.permute(Vec2(nx*0.9,ny*0.9));
-                        Vec4 newc = Vec4(red,green,blue,1.0);
-                        colors.push_back(newc);
-                        poses.push_back(Vec2(x,y));
-                        temps.push_back(temp * 100);
-                        //std::cout << "temp: " << temp << std::endl;
-                    } else {
-                        Vec4 newc = Vec4(alpha,alpha,alpha,1.0);
-                        colors.push_back(newc);
-                        poses.push_back(Vec2(x,y));
-                        temps.push_back(temp * 100);
-                    }
-                }
-            }
-        }
+        noiseFill(minx, miny, maxx, maxy, minChance, maxChance, color, noisemod, poses, colors, &temps);
         std::cout << "noise generated" << std::endl;
         bulkAddObjects(poses, colors, temps);
         return *this;
     }
 
+    /// @brief Selects the solver used by diffuseTemps().
+    /// @param solver Explicit and Implicit only take effect while every object sits on the lattice (see setLattice);
+    /// otherwise diffuseTemps() falls back to the neighbor solver.
+    /// @param stencilPoints 5 (edge neighbors) or 9 (edge and diagonal neighbors, weighted by 1/d^2).
+    /// @param implicitIterations Jacobi sweeps per implicit step.
+    /// @return Reference to self for chaining.
+    Grid2& setHeatSolver(HeatSolver solver, int stencilPoints = 5, int implicitIterations = 4) {
+        heatSolver = solver;
+        heatStencil = stencilPoints == 9 ? 9 : 5;
+        heatIterations = std::max(1, implicitIterations);
+        return *this;
+    }
+
+    /// @brief Enables red-black ordering for the neighbor solver in diffuseTemps().
+    /// @return Reference to self for chaining.
+    Grid2& useRedBlackOrdering(bool enable = true) {
+        heatRedBlack = enable;
+        return *this;
+    }
+
+    /// @brief Sets the colormap used by getTempAsFrame(), from cold to hot as evenly spaced 0-1 colors.
+    /// @details An empty palette restores the default grayscale ramp.
+    /// @return Reference to self for chaining.
+    Grid2& setHeatPalette(const std::vector<Vec4>& stops) {
+        heatPalette = stops;
+        return *this;
+    }
+
     /// @brief Finds temperature objects within a region.
     std::unordered_map<size_t, Temp*> findTempsInRegion(const Vec2& center, float radius) {
         std::unordered_map<size_t, Temp*> results;
         
-        // Get all IDs in the region
-        auto idsInRegion = spatialGrid.queryRange(center, radius);
-        results.reserve(idsInRegion.size());
-        
-        // Filter for ones that have temperature data
-        for (size_t id : idsInRegion) {
-            auto tempIt = tempMap.find(id);
-            if (tempIt != tempMap.end()) {
-                results.emplace(id, &tempIt->second);
+        // Filter the IDs in the region for ones that have temperature data
+        spatialGrid.forEachInRange(center, radius, [&](size_t id) {
+            if (Temp* temp = findTemp(id)) {
+                results.emplace(id, temp);
             }
-        }
+        });
         
         return results;
     }
@@ -1000,7 +2361,7 @@ public:
         for (size_t x = Min.x; x < Max.x; x++) {
             for (size_t y = Min.y; y < Max.y; y++) {
                 Vec2 pos = Vec2(x,y);
-                if (Positions.contains(pos)) continue;
+                if (containsPosition(pos)) continue;
                 Vec4 color = defaultBackgroundColor;
                 float size = 0.1;
                 newPos.push_back(pos);
@@ -1012,52 +2373,114 @@ public:
         return *this;
     }
 
-    /// @brief Smoothes temperatures across the grid using Inverse Distance Weighting from existing samples.
+    /// @brief Fills in a temperature for every object that has none, interpolated from the existing samples.
+    /// @details Push-pull pyramid: known temperatures are splatted into a grid over the bounding box, averaged
+    /// down level by level until one cell remains, then each level fills its gaps from a bilinear sample of the
+    /// level above on the way back up. Every level is processed row-parallel, so the whole fill is linear in
+    /// the number of cells instead of repeated neighbor searches around every sample.
     void gradTemps() {
+        TIME_FUNCTION;
         //run this at the start. it generates temps for the grid from a sampling
-        std::vector<Vec2> toProcess;
-        
+        if (tempCount() == 0) return;
         Vec2 Min, Max;
         getBoundingBox(Min, Max);
-        
         std::cout << "min: " << Min << std::endl;
         std::cout << "max: " << Max << std::endl;
-        for (size_t x = Min.x; x < Max.x; x++) {
-            for (size_t y = Min.y; y < Max.y; y++) {
-                Vec2 pasdfjlkasdfasdfjlkasdfjlk = Vec2(x,y);
-                toProcess.emplace_back(pasdfjlkasdfasdfjlkasdfjlk);
+
+        struct Level {
+            size_t width;
+            size_t height;
+            std::vector<float> value;
+            std::vector<float> weight;
+        };
+        int minx = static_cast<int>(std::floor(Min.x));
+        int miny = static_cast<int>(std::floor(Min.y));
+        std::vector<Level> levels(1);
+        levels[0].width = static_cast<int>(std::floor(Max.x)) - minx + 1;
+        levels[0].height = static_cast<int>(std::floor(Max.y)) - miny + 1;
+        levels[0].value.assign(levels[0].width * levels[0].height, 0.0f);
+        levels[0].weight.assign(levels[0].width * levels[0].height, 0.0f);
+        auto cellOf = [&](const Vec2& pos) {
+            size_t x = static_cast<int>(std::floor(pos.x)) - minx;
+            size_t y = static_cast<int>(std::floor(pos.y)) - miny;
+            return y * levels[0].width + x;
+        };
+        forEachTemp([&](size_t id, Temp& temp) {
+            size_t cell = cellOf(positionOf(id));
+            levels[0].value[cell] += temp.temp;
+            levels[0].weight[cell] += 1.0f;
+        });
+        for (size_t cell = 0; cell < levels[0].value.size(); ++cell) {
+            if (levels[0].weight[cell] > 0.0f) {
+                levels[0].value[cell] /= levels[0].weight[cell];
+                levels[0].weight[cell] = 1.0f;
             }
         }
 
-        while (toProcess.size() > 0) {
-            std::cout << "setting temp on " << toProcess.size() << " values" << std::endl;
-            for (size_t iter = 0; iter < toProcess.size(); iter++) {
-                Vec2 cpos = toProcess[iter];
-                size_t id = getPositionVec(cpos);
-                if (tempMap.find(id) != tempMap.end()) {
-                    toProcess.erase(toProcess.begin()+iter);
-                }
-            }
-            for (auto [id, temp] : tempMap) {
-                std::vector<size_t> neighbors = spatialGrid.queryRange(getPositionID(id), 35);
-                std::unordered_map<Vec2, Temp> neighbortemps;
-                for (size_t id : neighbors) {
-                    auto tempIt = tempMap.find(id);
-                    if (tempIt != tempMap.end()) {
-                        neighbortemps.insert({getPositionID(id), tempIt->second});
+        // pull: weighted 2x2 averages, weights saturate at 1
+        while (levels.back().width > 1 || levels.back().height > 1) {
+            const Level& child = levels.back();
+            Level parent;
+            parent.width = (child.width + 1) / 2;
+            parent.height = (child.height + 1) / 2;
+            parent.value.assign(parent.width * parent.height, 0.0f);
+            parent.weight.assign(parent.width * parent.height, 0.0f);
+            std::vector<size_t> rows(parent.height);
+            std::iota(rows.begin(), rows.end(), 0);
+            std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+                for (size_t x = 0; x < parent.width; ++x) {
+                    float sumW = 0.0f;
+                    float sumV = 0.0f;
+                    for (size_t cy = 2 * y; cy < std::min(2 * y + 2, child.height); ++cy) {
+                        for (size_t cx = 2 * x; cx < std::min(2 * x + 2, child.width); ++cx) {
+                            size_t c = cy * child.width + cx;
+                            sumW += child.weight[c];
+                            sumV += child.weight[c] * child.value[c];
+                        }
                     }
+                    size_t p = y * parent.width + x;
+                    parent.value[p] = sumW > 0.0f ? sumV / sumW : 0.0f;
+                    parent.weight[p] = std::min(sumW, 1.0f);
                 }
-                Vec2 pos = getPositionID(id);
-
-                for (size_t neighbor : neighbors) {
-                    // if (tempMap.find(neighbor) != tempMap.end()) {
-                        Vec2 npos = getPositionID(neighbor);
-                        float newtemp = Temp::calTempIDW(npos, neighbortemps);
-                        Temp newTempT = Temp(newtemp);
-                        tempMap.insert({neighbor, newTempT});
-                    // }
+            });
+            levels.push_back(std::move(parent));
+        }
+
+        // push: blend each cell's own estimate with the bilinear estimate from the coarser level
+        for (size_t l = levels.size() - 1; l-- > 0;) {
+            Level& level = levels[l];
+            const Level& parent = levels[l + 1];
+            std::vector<size_t> rows(level.height);
+            std::iota(rows.begin(), rows.end(), 0);
+            std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+                float v = std::clamp((y + 0.5f) / 2.0f - 0.5f, 0.0f, static_cast<float>(parent.height - 1));
+                size_t y0 = static_cast<size_t>(v);
+                size_t y1 = std::min(y0 + 1, parent.height - 1);
+                float fy = v - y0;
+                for (size_t x = 0; x < level.width; ++x) {
+                    size_t c = y * level.width + x;
+                    float w = level.weight[c];
+                    if (w >= 1.0f) continue;
+                    float u = std::clamp((x + 0.5f) / 2.0f - 0.5f, 0.0f, static_cast<float>(parent.width - 1));
+                    size_t x0 = static_cast<size_t>(u);
+                    size_t x1 = std::min(x0 + 1, parent.width - 1);
+                    float fx = u - x0;
+                    float top = parent.value[y0 * parent.width + x0] * (1 - fx) + parent.value[y0 * parent.width + x1] * fx;
+                    float bottom = parent.value[y1 * parent.width + x0] * (1 - fx) + parent.value[y1 * parent.width + x1] * fx;
+                    float coarse = top * (1 - fy) + bottom * fy;
+                    level.value[c] = w * level.value[c] + (1 - w) * coarse;
+                    level.weight[c] = 1.0f;
                 }
-            }
+            });
+        }
+
+        std::vector<std::pair<size_t, float>> filled;
+        forEachPosition([&](size_t id, const Vec2& pos) {
+            if (!findTemp(id)) filled.emplace_back(id, levels[0].value[cellOf(pos)]);
+        });
+        std::cout << "setting temp on " << filled.size() << " values" << std::endl;
+        for (const auto& [id, temp] : filled) {
+            storeTemp(id, Temp(temp));
         }
     }
 
@@ -1066,37 +2489,294 @@ public:
     /// @param deltaTime Time elapsed (in milliseconds) since last update.
     void diffuseTemps(float deltaTime) {
         TIME_FUNCTION;
-        if (tempMap.empty() || deltaTime <= 0) return;
-        
-        std::vector<std::pair<size_t, Temp*>> tempEntries;
-        tempEntries.reserve(tempMap.size());
-        
-        for (auto& [id, tempObj] : tempMap) {
-            tempEntries.emplace_back(id, &tempObj);
+        if (tempCount() == 0 || deltaTime <= 0) return;
+        tempFieldValid = false;
+        if (heatSolver != HeatSolver::Neighbors && latticeOnly()) {
+            diffuseLattice(deltaTime);
+            return;
         }
         
-        std::for_each(std::execution::par_unseq, tempEntries.begin(), tempEntries.end(),
-            [&](const std::pair<size_t, Temp*>& entry) {
-            size_t id = entry.first;
-            Temp* tempObj = entry.second;
-            Vec2 pos = Positions.at(id);
-            float oldtemp = tempObj->temp;
-                
-            auto nearbyIds = spatialGrid.queryRange(pos, neighborRadius * tempObj->conductivity);
-            
-            std::unordered_map<Vec2, Temp> neighborTemps;
-            for (size_t neighborId : nearbyIds) {
-                if (neighborId != id && tempMap.find(neighborId) != tempMap.end()) {
-                    neighborTemps.emplace(Positions.at(neighborId), tempMap.at(neighborId));
-                }
+        diffuseNeighbors(deltaTime);
+    }
+
+    /// @brief Largest diffuseTemps() step simulateTemps() will take, set by setHeatSchedule()'s maxRelax.
+    /// @details Every solver moves a temperature a fraction 1 - exp(-rate * dt) toward its neighbor mean, with
+    /// rate = Temp::relaxRate() of the object's material. That fraction never exceeds 1, so every step size
+    /// is stable; big steps are only coarser. Each step carries heat one neighbor ring, and past one half a
+    /// checkerboard pattern decays while flipping sign instead of smoothing monotonically. maxRelax caps the
+    /// fraction for the most diffusive material in use: 0.5 keeps every step monotone, 1 sets no cap. The
+    /// implicit lattice solver runs heatIterations sweeps per step, so its cap is that many times longer.
+    /// @return Step in milliseconds, infinity when uncapped, 0 if there are no temperatures.
+    float maxHeatStep() {
+        if (tempCount() == 0) return 0.0f;
+        if (heatMaxRelax >= 1.0f) return std::numeric_limits<float>::infinity();
+        std::vector<uint8_t> used(materials.size(), 0);
+        forEachTemp([&](size_t, Temp& temp) {
+            used[temp.material] = 1;
+        });
+        float maxRate = 0.0f;
+        for (size_t m = 0; m < used.size(); ++m) {
+            if (used[m]) maxRate = std::max(maxRate, materials.rate(static_cast<uint16_t>(m)));
+        }
+        if (maxRate <= 0.0f) return std::numeric_limits<float>::infinity();
+        float step = -std::log1p(-heatMaxRelax) / maxRate;
+        if (heatSolver == HeatSolver::Implicit && latticeOnly()) step *= heatIterations;
+        return step;
+    }
+
+    /// @brief Advances heat diffusion by one rendered frame in substeps of at most maxHeatStep().
+    /// @param frameTime Frame duration in milliseconds; timeScale in setHeatSchedule() speeds the simulation up.
+    /// @return Simulated milliseconds actually covered (less than asked when the frame budget runs out).
+    /// getHeatScheduleReport() has the substep details.
+    float simulateTemps(float frameTime) {
+        TIME_FUNCTION;
+        return heatScheduler.advance(frameTime, maxHeatStep(), [&](float dt) {
+            diffuseTemps(dt);
+        });
+    }
+
+    /// @brief Configures simulateTemps().
+    /// @param timeScale Simulated time per unit of frame time.
+    /// @param frameBudget Wall-clock seconds of diffusion work allowed per frame.
+    /// @param maxSubsteps Hard cap on substeps per frame.
+    /// @param maxRelax Largest fraction a temperature may move toward its neighbor mean per substep, see
+    /// maxHeatStep(). 1 (the default) lets each frame be one step; 0.5 keeps steps monotone at the cost of
+    /// many more substeps for diffusive materials.
+    /// @return Reference to self for chaining.
+    Grid2& setHeatSchedule(float timeScale, double frameBudget = 1.0 / 30.0, int maxSubsteps = 256, float maxRelax = 1.0f) {
+        heatMaxRelax = std::clamp(maxRelax, 1e-6f, 1.0f);
+        heatScheduler.timeScale = timeScale;
+        heatScheduler.frameBudget = frameBudget;
+        heatScheduler.maxSubsteps = maxSubsteps;
+        heatScheduler.reset();
+        return *this;
+    }
+
+    /// @brief Adds a water particle at pos.
+    /// @details Water is not a grid object: it has its own IDs (0, 1, 2, ... in insertion order) and lives in the
+    /// SPH solver's arrays, so it never takes lattice cells or slows the lattice paths. Renders blend it into
+    /// the pixels it covers.
+    /// @return The particle's water ID.
+    size_t addWater(const Vec2& pos, const WaterParticle& particle = WaterParticle(), const Vec4& color = Vec4(0.1f, 0.3f, 0.8f, 1.0f)) {
+        size_t id = water.size();
+        water.push_back(particle);
+        waterColors.push_back(color);
+        waterSlots.push_back(static_cast<uint32_t>(waterSolver.size()));
+        // rest density and viscosity are refreshed from the temperature at the start of every flowWater()
+        waterSolver.add(id, pos, Vec2(particle.velocity.x, particle.velocity.y), particle.mass, particle.density);
+        invalidateRender();
+        return id;
+    }
+
+    /// @brief Adds one water particle per position, all copies of particle.
+    /// @return The water ID of each input point, in input order.
+    std::vector<size_t> bulkAddWater(const std::vector<Vec2>& poses, const WaterParticle& particle = WaterParticle(), const Vec4& color = Vec4(0.1f, 0.3f, 0.8f, 1.0f)) {
+        TIME_FUNCTION;
+        std::vector<size_t> ids;
+        ids.reserve(poses.size());
+        water.reserve(water.size() + poses.size());
+        waterColors.reserve(waterColors.size() + poses.size());
+        waterSlots.reserve(waterSlots.size() + poses.size());
+        waterSolver.reserve(waterSolver.size() + poses.size());
+        for (const Vec2& pos : poses) {
+            ids.push_back(addWater(pos, particle, color));
+        }
+        return ids;
+    }
+
+    size_t waterCount() const {
+        return water.size();
+    }
+
+    /// @brief The thermodynamic state of a water particle.
+    /// @throws std::out_of_range if there is no such water ID.
+    const WaterParticle& getWater(size_t id) const {
+        return water.at(id);
+    }
+
+    /// @brief The position of a water particle.
+    /// @throws std::out_of_range if there is no such water ID.
+    Vec2 getWaterPosition(size_t id) const {
+        return waterSolver.positions[waterSlots.at(id)];
+    }
+
+    /// @brief Sets the SPH parameters used by flowWater().
+    /// @param smoothing Kernel radius in cells, about twice the particle spacing.
+    /// @param soundSpeed Pressure stiffness as a speed in cells/s; larger is less compressible but needs smaller steps.
+    /// @param viscosity Kinematic viscosity in cells^2/s at 20C.
+    /// @param gravity Acceleration in cells/s^2.
+    /// @return Reference to self for chaining.
+    Grid2& setWaterParameters(float smoothing, float soundSpeed, float viscosity, const Vec2& gravity = Vec2(0.0f, 9.81f)) {
+        waterSolver.settings.smoothing = smoothing;
+        waterSolver.settings.soundSpeed = soundSpeed;
+        waterSolver.settings.viscosity = viscosity;
+        waterSolver.settings.gravity = gravity;
+        return *this;
+    }
+
+    /// @brief Keeps water particles inside a rectangle. Without one, lattice grids use the lattice rectangle.
+    /// @return Reference to self for chaining.
+    Grid2& setWaterBounds(const Vec2& minCorner, const Vec2& maxCorner, float restitution = 0.3f) {
+        waterSolver.settings.bounded = true;
+        waterSolver.settings.boundsMin = minCorner;
+        waterSolver.settings.boundsMax = maxCorner;
+        waterSolver.settings.restitution = restitution;
+        return *this;
+    }
+
+    /// @brief Advances every water particle by one frame of SPH flow.
+    /// @details The solver's cell-sorted arrays hold the particles between frames. They are stepped in substeps
+    /// no larger than its stable step (frames that would take too long are spread out by the scheduler, as in
+    /// simulateTemps()), then velocities, densities and viscosities are copied to each WaterParticle. Each
+    /// particle's rest density and viscosity are refreshed from its temperature with WaterPropertyTable first.
+    /// SPH pressure is a stiffness term in grid units, not pascals, so WaterParticle::pressure is left alone.
+    /// @param frameTime Frame duration in seconds.
+    /// @return Simulated seconds actually covered.
+    float flowWater(float frameTime) {
+        TIME_FUNCTION;
+        if (water.empty()) return 0.0f;
+        SPHSolver2& solver = waterSolver;
+        if (!solver.settings.bounded && latticeMode) {
+            solver.settings.boundsMin = Vec2(latticeMinX, latticeMinY);
+            solver.settings.boundsMax = Vec2(latticeMinX + latticeWidth - 1, latticeMinY + latticeHeight - 1);
+        }
+        // rest density and viscosity for every particle's current temperature, in one batch
+        size_t count = solver.size();
+        std::vector<float> temperatures(count);
+        for (size_t i = 0; i < count; ++i) {
+            temperatures[i] = water[solver.ids[i]].temperature;
+        }
+        std::vector<float> viscosities(count);
+        WaterPropertyTable::instance().evaluate(temperatures.data(), solver.restDensities.data(), viscosities.data(), count);
+        for (size_t i = 0; i < count; ++i) {
+            solver.viscosityScales[i] = viscosities[i] / WaterConstants::VISCOSITY_20C;
+        }
+        bool latticeBounds = !solver.settings.bounded && latticeMode;
+        solver.settings.bounded = solver.settings.bounded || latticeBounds;
+
+        float simulated = waterScheduler.advance(frameTime, solver.stableStep(), [&](float dt) {
+            // the stable step shrinks as the flow speeds up, so split further if this substep outgrew it
+            while (dt > 0.0f) {
+                float step = std::min(dt, solver.stableStep());
+                solver.step(step);
+                dt -= step;
             }
-                
-            tempObj->calLapl(pos, neighborTemps, deltaTime);
-            float newtemp = tempObj->temp;
-            //float tempdiff = (oldtemp - newtemp) * (deltaTime / 1000);
-            //tempObj->temp = oldtemp - tempdiff;
+        });
+        if (latticeBounds) solver.settings.bounded = false;
+
+        for (size_t i = 0; i < count; ++i) {
+            waterSlots[solver.ids[i]] = static_cast<uint32_t>(i);
+            WaterParticle& particle = water[solver.ids[i]];
+            const Vec2& v = solver.velocities[i];
+            const Vec2& a = solver.accelerations[i];
+            particle.velocity = Vec3(v.x, v.y, 0.0f);
+            particle.acceleration = Vec3(a.x, a.y, 0.0f);
+            particle.force = particle.acceleration * particle.mass;
+            particle.density = solver.restDensities[i];
+            particle.viscosity = solver.viscosityScales[i] * WaterConstants::VISCOSITY_20C;
+            particle.volume = particle.mass / particle.density;
+        }
+        invalidateRender();
+        return simulated;
+    }
+
+    /// @brief Exchanges heat between water particles and the grid temperature under each of them.
+    /// @details Each particle is paired with the temperature object in its cell: the lattice entry on lattice
+    /// grids, otherwise the closest temperature within one cell through the spatial index. Each pair relaxes
+    /// with the exact two-body solution for conductance G (harmonic mean of the water and material
+    /// conductivities, unit contact area), so no step size can overshoot. A cell shared by k particles
+    /// lends each of them 1/k of its heat capacity (material density * specific heat), so together they
+    /// cannot overshoot it either. Energy lands on particles through addThermalEnergy(); particles are grouped by
+    /// cell and each cell sums their energy in particle order, so results do not depend on the thread count.
+    /// Particles, temperatures and positions are flattened to per-ID arrays up front, so the parallel passes do
+    /// no map lookups.
+    /// @param deltaTime Step in seconds.
+    /// @param kelvinOffset Added to grid temperatures to get kelvin, e.g. 273.15 for a grid in Celsius.
+    void exchangeWaterHeat(float deltaTime, float kelvinOffset = 0.0f) {
+        TIME_FUNCTION;
+        if (water.empty() || tempCount() == 0 || deltaTime <= 0.0f) return;
+        size_t slots = denseStorage ? dense.slots() : Positions.getNext_id();
+        std::vector<Temp*> tempByID(slots, nullptr);
+        forEachTemp([&](size_t id, Temp& temp) {
+            tempByID[id] = &temp;
+        });
+        // positionOf() is a hash lookup in map storage, so copy the positions the passes read
+        std::vector<Vec2> posByID(slots);
+        forEachPosition([&](size_t id, const Vec2& pos) {
+            if (tempByID[id]) posByID[id] = pos;
+        });
+
+        // pair every particle (in solver order) with a cell
+        const SPHSolver2& solver = waterSolver;
+        size_t count = solver.size();
+        std::vector<size_t> cellOf(count, NO_ID);
+        std::vector<size_t> order(count);
+        std::iota(order.begin(), order.end(), 0);
+        std::for_each(std::execution::par, order.begin(), order.end(), [&](size_t k) {
+            const Vec2& pos = solver.positions[k];
+            size_t index;
+            size_t cell = NO_ID;
+            if (latticeIndex(pos.floor(), index)) {
+                size_t id = latticeIDs[index];
+                if (id != NO_ID && tempByID[id]) cell = id;
+            }
+            if (cell == NO_ID) {
+                float best = std::numeric_limits<float>::max();
+                spatialGrid.forEachInRange(pos, 1.0f, [&](size_t id) {
+                    if (!tempByID[id]) return;
+                    float distSq = pos.distanceSquared(posByID[id]);
+                    if (distSq <= 1.0f && distSq < best) {
+                        best = distSq;
+                        cell = id;
+                    }
+                });
+            }
+            cellOf[k] = cell;
+        });
+
+        // group particles by cell (counting sort, particle order kept), so each cell sums its energy serially
+        std::vector<uint32_t> cellStart(slots + 1, 0);
+        for (size_t k = 0; k < count; ++k) {
+            if (cellOf[k] != NO_ID) cellStart[cellOf[k] + 1]++;
+        }
+        std::vector<size_t> cells;
+        for (size_t id = 0; id < slots; ++id) {
+            if (cellStart[id + 1] > 0) cells.push_back(id);
+        }
+        std::inclusive_scan(cellStart.begin(), cellStart.end(), cellStart.begin());
+        std::vector<uint32_t> byCell(cellStart.back());
+        std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+        for (size_t k = 0; k < count; ++k) {
+            if (cellOf[k] != NO_ID) byCell[fill[cellOf[k]]++] = static_cast<uint32_t>(k);
         }
-        );
+
+        const WaterPropertyTable& table = WaterPropertyTable::instance();
+        std::for_each(std::execution::par, cells.begin(), cells.end(), [&](size_t cell) {
+            Temp& temp = *tempByID[cell];
+            float cellK = materials.conductivity(temp.material);
+            float cellCapacity = materials.density(temp.material) * materials.specificHeat(temp.material);
+            float cellC = cellCapacity / (cellStart[cell + 1] - cellStart[cell]);
+            float cellEnergy = 0.0f;
+            for (uint32_t j = cellStart[cell]; j < cellStart[cell + 1]; ++j) {
+                WaterParticle& particle = water[solver.ids[byCell[j]]];
+                float waterK = table.conductivity(particle.temperature);
+                float conductance = waterK + cellK > 0.0f ? 2.0f * waterK * cellK / (waterK + cellK) : 0.0f;
+                float waterC = particle.mass * WaterConstants::SPECIFIC_HEAT_CAPACITY;
+                float inverseC = 1.0f / waterC + 1.0f / cellC;
+                float difference = (temp.temp + kelvinOffset) - particle.temperature;
+                float energy = difference * (1.0f - std::exp(-conductance * inverseC * deltaTime)) / inverseC;
+                particle.addThermalEnergy(energy);
+                particle.updatePhase();
+                cellEnergy -= energy;
+            }
+            temp.temp += cellEnergy / cellCapacity;
+        });
+        tempFieldValid = false;
+    }
+
+    /// @brief Substep count, size and backlog of the last simulateTemps() call.
+    const SubstepScheduler::Report& getHeatScheduleReport() const {
+        return heatScheduler.last;
     }
 };
 
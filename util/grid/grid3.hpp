@@ -11,10 +11,16 @@
 #include <unordered_set>
 #include <execution>
 #include <algorithm>
+#include <numeric>
 #include "../ray3.hpp"
+#include <limits>
+#include <cstdint>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
 
 constexpr float EPSILON = 0.0000000000000000000000001;
-constexpr int CHUNK_SIZE = 16;
 
 /// @brief Represents a single point in the grid with an ID, color, and position.
 class GenericVoxel {
@@ -66,7 +72,7 @@ private:
     std::unordered_map<size_t, Vec3f> Positions;
     /// "Positions" reversed - stores the reverse mapping from Vec3f to ID.
     std::unordered_map<Vec3f, size_t, Vec3f::Hash> ƨnoiƚiƨoꟼ;
-    size_t next_id;
+    size_t next_id = 0;
 public:
     /// @brief Get the Position associated with a specific ID.
     /// @throws std::out_of_range if the ID does not exist.
@@ -96,11 +102,21 @@ public:
         return id;
     }
 
+    /// @brief Moves an existing ID to a new position.
+    void move(size_t id, const Vec3f& pos) {
+        Vec3f& current = Positions.at(id);
+        auto it = ƨnoiƚiƨoꟼ.find(current);
+        if (it != ƨnoiƚiƨoꟼ.end() && it->second == id) ƨnoiƚiƨoꟼ.erase(it);
+        current = pos;
+        ƨnoiƚiƨoꟼ[pos] = id;
+    }
+
     /// @brief Removes an entry by ID.
     size_t remove(size_t id) {
-        Vec3f& pos = Positions[id];
+        Vec3f pos = Positions[id];
         Positions.erase(id);
-        ƨnoiƚiƨoꟼ.erase(pos);
+        auto it = ƨnoiƚiƨoꟼ.find(pos);
+        if (it != ƨnoiƚiƨoꟼ.end() && it->second == id) ƨnoiƚiƨoꟼ.erase(it);
         return id;
     }
 
@@ -172,73 +188,438 @@ public:
     }
 };
 
-class Chunk3 : public GenericVoxel {
-private:
-    Vec3f chunkCoord;
-    std::unordered_set<size_t> voxelIDs;
-    bool isCompressed = false;
-    int detailLevel;
-    std::vector<GenericVoxel> fullVoxels;
-    std::vector<uint16_t> compressedVoxels;
+/// @brief Dense 8x8x8 brick of voxel colors with an occupancy bitmask, the storage unit of BrickMap3.
+/// @details Slots are in x-fastest order; a voxel is its 4 color bytes plus one occupancy bit.
+class Chunk3 {
 public:
-    //overload GenericVoxel
-    Vec4ui8 getColor() {
-        if (isCompressed) {
-            return color;
-        } else {
-            if (fullVoxels.empty()) {
-                return Vec4ui8();
+    static constexpr int SIZE = 8;
+    static constexpr int VOLUME = SIZE * SIZE * SIZE;
+    uint64_t mask[VOLUME / 64] = {};
+    Vec4ui8 colors[VOLUME];
+
+    static int index(int x, int y, int z) {
+        return (z * SIZE + y) * SIZE + x;
+    }
+
+    static Vec3i cellOf(int index) {
+        return Vec3i(index % SIZE, (index / SIZE) % SIZE, index / (SIZE * SIZE));
+    }
+
+    bool has(int index) const {
+        return mask[index >> 6] & (uint64_t(1) << (index & 63));
+    }
+
+    /// @return true if the slot was empty before.
+    bool set(int index, const Vec4ui8& color) {
+        bool added = !has(index);
+        mask[index >> 6] |= uint64_t(1) << (index & 63);
+        colors[index] = color;
+        return added;
+    }
+
+    /// @return true if the slot was occupied.
+    bool erase(int index) {
+        bool removed = has(index);
+        mask[index >> 6] &= ~(uint64_t(1) << (index & 63));
+        return removed;
+    }
+
+    int count() const {
+        int total = 0;
+        for (uint64_t word : mask) total += std::popcount(word);
+        return total;
+    }
+
+    bool empty() const {
+        for (uint64_t word : mask) {
+            if (word) return false;
+        }
+        return true;
+    }
+
+    /// @brief Calls fn(index, color) for every occupied slot in index order.
+    template<typename Func>
+    void forEach(Func&& fn) const {
+        for (int word = 0; word < VOLUME / 64; ++word) {
+            for (uint64_t bits = mask[word]; bits; bits &= bits - 1) {
+                int index = word * 64 + std::countr_zero(bits);
+                fn(index, colors[index]);
             }
-            
-            Vec4ui8 accumulatedColor(0, 0, 0, 0);
-            
-            for (const auto& voxel : fullVoxels) {
-                accumulatedColor = accumulatedColor + voxel.getColor();
+        }
+    }
+
+    /// @brief Mean color of the occupied voxels, e.g. for a coarser level of detail.
+    Vec4ui8 getColor() const {
+        uint32_t sum[4] = {};
+        int n = 0;
+        forEach([&](int, const Vec4ui8& color) {
+            sum[0] += color.r;
+            sum[1] += color.g;
+            sum[2] += color.b;
+            sum[3] += color.a;
+            n++;
+        });
+        if (n == 0) return Vec4ui8();
+        return Vec4ui8(sum[0] / n, sum[1] / n, sum[2] / n, sum[3] / n);
+    }
+
+    /// @brief Serializes the brick: the occupancy mask, then the occupied voxels' colors in index order,
+    /// run-length encoded as (run length, r, g, b, a) with runs of at most 255.
+    std::vector<uint8_t> compress() const {
+        std::vector<uint8_t> out(sizeof(mask));
+        std::memcpy(out.data(), mask, sizeof(mask));
+        uint8_t run = 0;
+        Vec4ui8 current;
+        auto flush = [&]() {
+            if (run == 0) return;
+            out.insert(out.end(), {run, current.r, current.g, current.b, current.a});
+            run = 0;
+        };
+        forEach([&](int, const Vec4ui8& color) {
+            if (run > 0 && (run == 255 || !(color == current))) flush();
+            current = color;
+            run++;
+        });
+        flush();
+        return out;
+    }
+
+    /// @brief Restores a brick written by compress().
+    /// @throws std::runtime_error if the data is truncated or does not match its mask.
+    void decompress(const std::vector<uint8_t>& data) {
+        if (data.size() < sizeof(mask)) throw std::runtime_error("Chunk3 data truncated");
+        std::memcpy(mask, data.data(), sizeof(mask));
+        size_t pos = sizeof(mask);
+        int remaining = 0;
+        Vec4ui8 current;
+        bool valid = true;
+        forEach([&](int index, const Vec4ui8&) {
+            if (remaining == 0) {
+                if (pos + 5 > data.size()) {
+                    valid = false;
+                    return;
+                }
+                remaining = data[pos];
+                current = Vec4ui8(data[pos + 1], data[pos + 2], data[pos + 3], data[pos + 4]);
+                pos += 5;
             }
-            
-            float count = static_cast<float>(fullVoxels.size());
-            return accumulatedColor / count;
+            colors[index] = current;
+            remaining--;
+        });
+        if (!valid || remaining != 0 || pos != data.size()) throw std::runtime_error("Chunk3 data does not match its mask");
+    }
+};
+
+/// @brief Sparse voxel store: Chunk3 bricks kept in a pool and found through a hash of brick coordinates.
+/// @details Voxels sit at integer cells. Bricks are only allocated where something is, so a voxel costs
+/// about 4 bytes of color, an occupancy bit and a share of one hash entry per brick, and the neighbors of a
+/// cell almost always live in the same brick. Bricks that empty out go back on a free list.
+class BrickMap3 {
+private:
+    std::unordered_map<uint64_t, uint32_t> index;
+    std::vector<Chunk3> pool;
+    //brick coordinate of each pool slot
+    std::vector<Vec3i> coords;
+    std::vector<uint32_t> freeSlots;
+    size_t voxelCount = 0;
+    //bumped whenever a brick is allocated or freed
+    uint64_t layoutVersion = 0;
+
+    static_assert(Chunk3::SIZE == 8, "brickOf() and localIndex() assume 8^3 bricks");
+
+public:
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+    /// @brief Brick coordinate containing a cell (floor division, also for negative cells).
+    static Vec3i brickOf(const Vec3i& cell) {
+        return Vec3i(cell.x >> 3, cell.y >> 3, cell.z >> 3);
+    }
+
+    static int localIndex(const Vec3i& cell) {
+        return Chunk3::index(cell.x & 7, cell.y & 7, cell.z & 7);
+    }
+
+    /// @brief Integer cell containing a world position.
+    static Vec3i cellOf(const Vec3f& pos) {
+        return Vec3i(static_cast<int>(std::floor(pos.x)), static_cast<int>(std::floor(pos.y)), static_cast<int>(std::floor(pos.z)));
+    }
+
+    static uint64_t key(const Vec3i& brick) {
+        constexpr uint64_t bias = uint64_t(1) << 20;
+        constexpr uint64_t bits = (uint64_t(1) << 21) - 1;
+        return ((brick.x + bias) & bits) | (((brick.y + bias) & bits) << 21) | (((brick.z + bias) & bits) << 42);
+    }
+
+    /// @brief Inverse of key() for coordinates within +-2^20.
+    static Vec3i unkey(uint64_t k) {
+        constexpr int64_t bias = int64_t(1) << 20;
+        constexpr uint64_t bits = (uint64_t(1) << 21) - 1;
+        return Vec3i(static_cast<int>(static_cast<int64_t>(k & bits) - bias),
+                     static_cast<int>(static_cast<int64_t>((k >> 21) & bits) - bias),
+                     static_cast<int>(static_cast<int64_t>((k >> 42) & bits) - bias));
+    }
+
+    /// @return Pool slot of a brick, or NONE if it holds nothing.
+    uint32_t slotOf(const Vec3i& brick) const {
+        auto it = index.find(key(brick));
+        return it == index.end() ? NONE : it->second;
+    }
+
+    const Chunk3& brick(uint32_t slot) const {
+        return pool[slot];
+    }
+
+    const Vec3i& brickCoord(uint32_t slot) const {
+        return coords[slot];
+    }
+
+    /// @brief Number of pool slots, including freed (empty) ones.
+    size_t slotCount() const {
+        return pool.size();
+    }
+
+    /// @return true if the cell was empty before.
+    bool set(const Vec3i& cell, const Vec4ui8& color) {
+        Vec3i b = brickOf(cell);
+        auto [it, inserted] = index.try_emplace(key(b), NONE);
+        if (inserted) {
+            if (freeSlots.empty()) {
+                it->second = static_cast<uint32_t>(pool.size());
+                pool.emplace_back();
+                coords.push_back(b);
+            } else {
+                it->second = freeSlots.back();
+                freeSlots.pop_back();
+                coords[it->second] = b;
+            }
+            layoutVersion++;
         }
+        bool added = pool[it->second].set(localIndex(cell), color);
+        voxelCount += added;
+        return added;
     }
 
-    Chunk3(const Vec3f& coord) : chunkCoord(coord) {}
+    /// @return true if the cell held a voxel.
+    bool erase(const Vec3i& cell) {
+        auto it = index.find(key(brickOf(cell)));
+        if (it == index.end()) return false;
+        Chunk3& chunk = pool[it->second];
+        if (!chunk.erase(localIndex(cell))) return false;
+        voxelCount--;
+        if (chunk.empty()) {
+            freeSlots.push_back(it->second);
+            index.erase(it);
+            layoutVersion++;
+        }
+        return true;
+    }
 
-    Vec3f getCoord() const { return chunkCoord; }
+    bool get(const Vec3i& cell, Vec4ui8& color) const {
+        uint32_t slot = slotOf(brickOf(cell));
+        if (slot == NONE) return false;
+        int local = localIndex(cell);
+        if (!pool[slot].has(local)) return false;
+        color = pool[slot].colors[local];
+        return true;
+    }
 
-    std::pair<Vec3f, Vec3f> getBounds() const {
-        Vec3f minBound(
-            chunkCoord.x*CHUNK_SIZE,
-            chunkCoord.y*CHUNK_SIZE,
-            chunkCoord.z*CHUNK_SIZE
-        );
-        Vec3f maxBound(
-            minBound.x+CHUNK_SIZE,
-            minBound.y+CHUNK_SIZE,
-            minBound.z+CHUNK_SIZE
-        );
-        return {minBound, maxBound};
+    bool contains(const Vec3i& cell) const {
+        uint32_t slot = slotOf(brickOf(cell));
+        return slot != NONE && pool[slot].has(localIndex(cell));
     }
-    
-    Vec3f worldToChunkPos(const Vec3f& worldPos) const {
-        auto [minBound, _] = getBounds();
-        return worldPos - minBound;
+
+    size_t size() const {
+        return voxelCount;
     }
 
-    std::vector<uint8_t> compress() {
-        for (auto value : fullVoxels) {
-            
-            
+    bool empty() const {
+        return voxelCount == 0;
+    }
+
+    size_t brickCount() const {
+        return index.size();
+    }
+
+    /// @brief Changes whenever bricks are allocated or freed, but not when voxels inside them change.
+    uint64_t version() const {
+        return layoutVersion;
+    }
+
+    /// @brief Approximate heap bytes held by the store.
+    size_t memoryUsage() const {
+        size_t node = sizeof(std::pair<const uint64_t, uint32_t>) + 2 * sizeof(void*);
+        return pool.capacity() * sizeof(Chunk3) + coords.capacity() * sizeof(Vec3i) + freeSlots.capacity() * sizeof(uint32_t)
+            + index.size() * node + index.bucket_count() * sizeof(void*);
+    }
+
+    /// @brief Calls fn(slot, brickCoord, chunk) for every allocated brick.
+    template<typename Func>
+    void forEachBrick(Func&& fn) const {
+        for (const auto& [k, slot] : index) {
+            fn(slot, coords[slot], pool[slot]);
+        }
+    }
+
+    /// @brief Calls fn(cell, color) for every voxel, brick by brick.
+    template<typename Func>
+    void forEachVoxel(Func&& fn) const {
+        forEachBrick([&](uint32_t, const Vec3i& b, const Chunk3& chunk) {
+            chunk.forEach([&](int local, const Vec4ui8& color) {
+                Vec3i offset = Chunk3::cellOf(local);
+                fn(Vec3i(b.x * Chunk3::SIZE + offset.x, b.y * Chunk3::SIZE + offset.y, b.z * Chunk3::SIZE + offset.z), color);
+            });
+        });
+    }
+
+    /// @brief Calls fn(cell, color) for every voxel in the inclusive cell box [lo, hi].
+    /// @details Looks up each overlapped brick once and reads its slots directly.
+    template<typename Func>
+    void forEachInBox(const Vec3i& lo, const Vec3i& hi, Func&& fn) const {
+        Vec3i blo = brickOf(lo);
+        Vec3i bhi = brickOf(hi);
+        for (int bz = blo.z; bz <= bhi.z; ++bz) {
+            for (int by = blo.y; by <= bhi.y; ++by) {
+                for (int bx = blo.x; bx <= bhi.x; ++bx) {
+                    uint32_t slot = slotOf(Vec3i(bx, by, bz));
+                    if (slot == NONE) continue;
+                    const Chunk3& chunk = pool[slot];
+                    int x0 = std::max(lo.x, bx * 8), x1 = std::min(hi.x, bx * 8 + 7);
+                    int y0 = std::max(lo.y, by * 8), y1 = std::min(hi.y, by * 8 + 7);
+                    int z0 = std::max(lo.z, bz * 8), z1 = std::min(hi.z, bz * 8 + 7);
+                    for (int z = z0; z <= z1; ++z) {
+                        for (int y = y0; y <= y1; ++y) {
+                            for (int x = x0; x <= x1; ++x) {
+                                int local = Chunk3::index(x & 7, y & 7, z & 7);
+                                if (chunk.has(local)) fn(Vec3i(x, y, z), chunk.colors[local]);
+                            }
+                        }
+                    }
+                }
+            }
         }
     }
+
+    void reserveBricks(size_t bricks) {
+        index.reserve(bricks);
+        pool.reserve(bricks);
+        coords.reserve(bricks);
+    }
+
+    void clear() {
+        index.clear();
+        index.rehash(0);
+        pool.clear();
+        pool.shrink_to_fit();
+        coords.clear();
+        coords.shrink_to_fit();
+        freeSlots.clear();
+        voxelCount = 0;
+        layoutVersion++;
+    }
 };
 
 /// @brief Accelerates spatial queries by bucketizing positions into a grid.
+/// @details Laid out like the 2D SpatialGrid: cells live in a flat open-addressing table keyed by integer
+/// cell coordinates, each holding the head of an intrusive linked list threaded through a per-ID `next`
+/// array, and every ID's position is kept next to its link. Queries walk those arrays through a visitor,
+/// so nothing is allocated per cell or per query.
 class SpatialGrid3 {
 private:
+    static constexpr size_t UNUSED = std::numeric_limits<size_t>::max();
+    static constexpr size_t NONE = std::numeric_limits<size_t>::max() - 1;
+
+    struct Cell {
+        int32_t x;
+        int32_t y;
+        int32_t z;
+        size_t head;
+    };
+
     float cellSize;
+    std::vector<Cell> table;
+    //per-ID list link and position side by side, so walking a cell reads one line per ID
+    struct Link {
+        Vec3f pos = Vec3f(std::numeric_limits<float>::quiet_NaN(), 0.0f, 0.0f);
+        size_t next = NONE;
+    };
+    std::vector<Link> links;
+    size_t usedCells = 0;
+    size_t count = 0;
+
+    static size_t hashCell(int32_t x, int32_t y, int32_t z) {
+        uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(x)) * 0x9E3779B97F4A7C15ull;
+        h ^= static_cast<uint64_t>(static_cast<uint32_t>(y)) * 0xC2B2AE3D27D4EB4Full;
+        h ^= static_cast<uint64_t>(static_cast<uint32_t>(z)) * 0x165667B19E3779F9ull;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+
+    /// @brief Returns the table slot of a cell, or UNUSED if the cell has never been created.
+    size_t findSlot(int32_t x, int32_t y, int32_t z) const {
+        if (table.empty()) return UNUSED;
+        size_t mask = table.size() - 1;
+        for (size_t slot = hashCell(x, y, z) & mask;; slot = (slot + 1) & mask) {
+            const Cell& cell = table[slot];
+            if (cell.head == UNUSED) return UNUSED;
+            if (cell.x == x && cell.y == y && cell.z == z) return slot;
+        }
+    }
+
+    size_t findOrCreateSlot(int32_t x, int32_t y, int32_t z) {
+        if ((usedCells + 1) * 2 > table.size()) rehash(std::max<size_t>(64, table.size() * 2));
+        size_t mask = table.size() - 1;
+        for (size_t slot = hashCell(x, y, z) & mask;; slot = (slot + 1) & mask) {
+            Cell& cell = table[slot];
+            if (cell.head == UNUSED) {
+                cell = Cell{x, y, z, NONE};
+                usedCells++;
+                return slot;
+            }
+            if (cell.x == x && cell.y == y && cell.z == z) return slot;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        size_t size = 64;
+        while (size < capacity) size *= 2;
+        std::vector<Cell> old = std::move(table);
+        table.assign(size, Cell{0, 0, 0, UNUSED});
+        size_t mask = size - 1;
+        for (const Cell& cell : old) {
+            if (cell.head == UNUSED) continue;
+            size_t slot = hashCell(cell.x, cell.y, cell.z) & mask;
+            while (table[slot].head != UNUSED) slot = (slot + 1) & mask;
+            table[slot] = cell;
+        }
+    }
+
+    int32_t toCell(float v) const {
+        return static_cast<int32_t>(std::floor(v / cellSize));
+    }
+
+    /// @brief Visits the IDs of one cell that lie within radiusSq of center.
+    template<typename Func>
+    void visitCellWithin(const Vec3f& center, float radiusSq, int32_t x, int32_t y, int32_t z, Func& fn) const {
+        size_t slot = findSlot(x, y, z);
+        if (slot == UNUSED) return;
+        for (size_t id = table[slot].head; id != NONE; id = links[id].next) {
+            if (links[id].pos.distanceSquared(center) <= radiusSq) fn(id);
+        }
+    }
 public:
-    std::unordered_map<Vec3f, std::unordered_set<size_t>, Vec3f::Hash> grid;
-    
+    /// @brief Cell offsets, relative to a query's own cell, that can hold points within a radius.
+    /// @details Stored as one run of x offsets per (dy, dz) row. Rows and row ends that no point of the query
+    /// cell can reach are left out, so a large radius visits a sphere of cells rather than a cube.
+    struct CellOffsets {
+        struct Row {
+            int32_t dy;
+            int32_t dz;
+            int32_t x0;
+            int32_t x1;
+        };
+        float radius = 0.0f;
+        std::vector<Row> rows;
+    };
+
     /// @brief Initializes the spatial grid.
     /// @param cellSize The dimension of the spatial buckets. Larger cells mean more items per bucket but fewer buckets.
     SpatialGrid3(float cellSize = 2.0f) : cellSize(cellSize) {}
@@ -247,22 +628,39 @@ public:
     Vec3f worldToGrid(const Vec3f& worldPos) const {
         return (worldPos / cellSize).floor();
     }
+
+    /// @brief Pre-sizes the cell table and the per-ID links for the expected number of cells and IDs.
+    void reserve(size_t cells, size_t ids) {
+        if (cells * 2 > table.size()) rehash(cells * 2);
+        if (ids > links.size()) links.resize(ids);
+    }
     
     /// @brief Adds an object ID to the spatial index at the given position.
+    /// @details An ID that is already indexed is left where it is, like a duplicate insert into a set;
+    /// use update() to move it. Linking it again would make its cell's list loop.
     void insert(size_t id, const Vec3f& pos) {
-        Vec3f gridPos = worldToGrid(pos);
-        grid[gridPos].insert(id);
+        if (id >= links.size()) links.resize(std::max(id + 1, links.size() * 2));
+        if (contains(id)) return;
+        Cell& cell = table[findOrCreateSlot(toCell(pos.x), toCell(pos.y), toCell(pos.z))];
+        links[id].next = cell.head;
+        links[id].pos = pos;
+        cell.head = id;
+        count++;
     }
     
     /// @brief Removes an object ID from the spatial index.
     void remove(size_t id, const Vec3f& pos) {
-        Vec3f gridPos = worldToGrid(pos);
-        auto cellIt = grid.find(gridPos);
-        if (cellIt != grid.end()) {
-            cellIt->second.erase(id);
-            if (cellIt->second.empty()) {
-                grid.erase(cellIt);
+        size_t slot = findSlot(toCell(pos.x), toCell(pos.y), toCell(pos.z));
+        if (slot == UNUSED) return;
+        size_t* link = &table[slot].head;
+        while (*link != NONE) {
+            if (*link == id) {
+                *link = links[id].next;
+                links[id] = Link();
+                count--;
+                return;
             }
+            link = &links[*link].next;
         }
     }
     
@@ -274,73 +672,415 @@ public:
         if (oldGridPos != newGridPos) {
             remove(id, oldPos);
             insert(id, newPos);
+        } else {
+            links[id].pos = newPos;
+        }
+    }
+
+    /// @brief Position an ID was last inserted or updated at.
+    const Vec3f& positionOf(size_t id) const {
+        return links[id].pos;
+    }
+
+    bool contains(size_t id) const {
+        return id < links.size() && !std::isnan(links[id].pos.x);
+    }
+
+    /// @brief Calls fn(id) for every ID in the cell containing 'center'.
+    template<typename Func>
+    void forEachInCell(const Vec3f& center, Func&& fn) const {
+        size_t slot = findSlot(toCell(center.x), toCell(center.y), toCell(center.z));
+        if (slot == UNUSED) return;
+        for (size_t id = table[slot].head; id != NONE; id = links[id].next) {
+            fn(id);
+        }
+    }
+
+    /// @brief Returns the first ID in the cell containing 'center' that satisfies pred, or SIZE_MAX if none does.
+    template<typename Pred>
+    size_t findInCell(const Vec3f& center, Pred&& pred) const {
+        size_t slot = findSlot(toCell(center.x), toCell(center.y), toCell(center.z));
+        if (slot == UNUSED) return std::numeric_limits<size_t>::max();
+        for (size_t id = table[slot].head; id != NONE; id = links[id].next) {
+            if (pred(id)) return id;
         }
+        return std::numeric_limits<size_t>::max();
     }
     
     /// @brief Returns all IDs located in the specific grid cell containing 'center'.
-    std::unordered_set<size_t> find(const Vec3f& center) const {
-        auto cellIt = grid.find(worldToGrid(center));
-        if (cellIt != grid.end()) {
-            return cellIt->second;
+    std::vector<size_t> find(const Vec3f& center) const {
+        std::vector<size_t> results;
+        forEachInCell(center, [&](size_t id) {
+            results.push_back(id);
+        });
+        return results;
+    }
+
+    /// @brief Precomputes the cells a query of this radius has to look at, for forEachWithin().
+    CellOffsets cellOffsets(float radius) const {
+        CellOffsets cells;
+        cells.radius = radius;
+        int32_t reach = static_cast<int32_t>(std::ceil(radius / cellSize));
+        float radiusSq = radius * radius;
+        // closest approach along one axis between the query cell and a cell d away
+        auto gap = [&](int32_t d) {
+            return std::max(std::abs(d) - 1, 0) * cellSize;
+        };
+        for (int32_t dz = -reach; dz <= reach; ++dz) {
+            for (int32_t dy = -reach; dy <= reach; ++dy) {
+                float rest = radiusSq - gap(dy) * gap(dy) - gap(dz) * gap(dz);
+                if (rest < 0.0f) continue;
+                int32_t dx = std::min(reach, static_cast<int32_t>(std::sqrt(rest) / cellSize) + 1);
+                cells.rows.push_back(CellOffsets::Row{dy, dz, -dx, dx});
+            }
         }
-        return std::unordered_set<size_t>();
+        return cells;
     }
 
-    /// @brief Finds all object IDs within a square area around the center.
-    /// @param center The world position center.
-    /// @param radius The search radius (defines the bounds of grid cells to check).
-    /// @return A vector of candidate IDs (Note: this returns objects in valid grid cells, further distance checks may be required).
-    std::vector<size_t> queryRange(const Vec3f& center, float radius) const {
-        std::vector<size_t> results;
+    /// @brief Calls fn(id) for every object within cells.radius of center, using precomputed offsets.
+    /// @details Does not allocate; each row is clipped to the cells the query's own bounds overlap, and the
+    /// distance check is done here against the stored positions.
+    template<typename Func>
+    void forEachWithin(const Vec3f& center, const CellOffsets& cells, Func&& fn) const {
+        if (table.empty()) return;
+        float radius = cells.radius;
         float radiusSq = radius * radius;
-        
-        // Calculate grid bounds for the query
-        Vec3f minGrid = worldToGrid(center - Vec3f(radius, radius, radius));
-        Vec3f maxGrid = worldToGrid(center + Vec3f(radius, radius, radius));
-        
-        size_t estimatedSize = (maxGrid.x - minGrid.x + 1) * (maxGrid.y - minGrid.y + 1) * (maxGrid.z - minGrid.z + 1) * 10;
-        results.reserve(estimatedSize);
-
-        // Check all relevant grid cells
-        for (int x = minGrid.x; x <= maxGrid.x; ++x) {
-            for (int y = minGrid.y; y <= maxGrid.y; ++y) {
-                for (int z = minGrid.z; z <= minGrid.z; ++z) {
-                    auto cellIt = grid.find(Vec3f(x, y, z));
-                    if (cellIt != grid.end()) {
-                        results.insert(results.end(), cellIt->second.begin(), cellIt->second.end());
+        int32_t cx = toCell(center.x);
+        int32_t cy = toCell(center.y);
+        int32_t cz = toCell(center.z);
+        int32_t minX = toCell(center.x - radius);
+        int32_t maxX = toCell(center.x + radius);
+        int32_t minY = toCell(center.y - radius);
+        int32_t maxY = toCell(center.y + radius);
+        int32_t minZ = toCell(center.z - radius);
+        int32_t maxZ = toCell(center.z + radius);
+        for (const CellOffsets::Row& row : cells.rows) {
+            int32_t y = cy + row.dy;
+            int32_t z = cz + row.dz;
+            if (y < minY || y > maxY || z < minZ || z > maxZ) continue;
+            int32_t x1 = std::min(cx + row.x1, maxX);
+            for (int32_t x = std::max(cx + row.x0, minX); x <= x1; ++x) {
+                visitCellWithin(center, radiusSq, x, y, z, fn);
+            }
+        }
+    }
+
+    /// @brief Calls fn(id) for every object within radius of center.
+    /// @details Does not allocate; the distance check is done here against the stored positions.
+    template<typename Func>
+    void forEachWithin(const Vec3f& center, float radius, Func&& fn) const {
+        if (table.empty()) return;
+        float radiusSq = radius * radius;
+        int32_t minX = toCell(center.x - radius);
+        int32_t maxX = toCell(center.x + radius);
+        int32_t minY = toCell(center.y - radius);
+        int32_t maxY = toCell(center.y + radius);
+        int32_t minZ = toCell(center.z - radius);
+        int32_t maxZ = toCell(center.z + radius);
+        for (int32_t z = minZ; z <= maxZ; ++z) {
+            for (int32_t y = minY; y <= maxY; ++y) {
+                for (int32_t x = minX; x <= maxX; ++x) {
+                    visitCellWithin(center, radiusSq, x, y, z, fn);
+                }
+            }
+        }
+    }
+
+    /// @brief Calls fn(id) for every object in the grid cells overlapping the cube around center.
+    /// @details Does not allocate. Candidates still need a distance check by the caller.
+    template<typename Func>
+    void forEachInRange(const Vec3f& center, float radius, Func&& fn) const {
+        if (table.empty()) return;
+        int32_t minX = toCell(center.x - radius);
+        int32_t maxX = toCell(center.x + radius);
+        int32_t minY = toCell(center.y - radius);
+        int32_t maxY = toCell(center.y + radius);
+        int32_t minZ = toCell(center.z - radius);
+        int32_t maxZ = toCell(center.z + radius);
+        for (int32_t z = minZ; z <= maxZ; ++z) {
+            for (int32_t y = minY; y <= maxY; ++y) {
+                for (int32_t x = minX; x <= maxX; ++x) {
+                    size_t slot = findSlot(x, y, z);
+                    if (slot == UNUSED) continue;
+                    for (size_t id = table[slot].head; id != NONE; id = links[id].next) {
+                        fn(id);
                     }
                 }
             }
         }
-        
+    }
+
+    /// @brief Finds all object IDs within a cube around the center.
+    /// @param center The world position center.
+    /// @param radius The search radius (defines the bounds of grid cells to check).
+    /// @return A vector of candidate IDs (Note: this returns objects in valid grid cells, further distance checks may be required).
+    std::vector<size_t> queryRange(const Vec3f& center, float radius) const {
+        std::vector<size_t> results;
+        forEachInRange(center, radius, [&](size_t id) {
+            results.push_back(id);
+        });
         return results;
     }
+
+    size_t size() const {
+        return count;
+    }
     
     void clear() {
-        grid.clear();
-        grid.rehash(0);
+        table.clear();
+        table.shrink_to_fit();
+        links.clear();
+        links.shrink_to_fit();
+        usedCells = 0;
+        count = 0;
     }
 };
 
+/// @brief Pinhole camera used by Grid3's ray-caster.
+struct Camera3 {
+    Vec3f position;
+    Vec3f target;
+    Vec3f up = Vec3f(0, 1, 0);
+    /// vertical field of view in degrees
+    float fov = 60.0f;
+
+    Camera3() : position(0, 0, -1), target(0, 0, 0) {}
+    Camera3(const Vec3f& position, const Vec3f& target, float fov = 60.0f, const Vec3f& up = Vec3f(0, 1, 0))
+        : position(position), target(target), up(up), fov(fov) {}
+
+    /// @brief Camera at the ray's origin looking along it; a zero direction looks at fallbackTarget instead.
+    static Camera3 fromRay(const Ray3<float>& view, const Vec3f& fallbackTarget, float fov = 60.0f) {
+        bool aimed = view.direction.lengthSquared() > 0.0f;
+        return Camera3(view.origin, aimed ? view.origin + view.direction : fallbackTarget, fov);
+    }
+
+    /// @brief Orthonormal forward/right/up basis, falling back to another up vector when looking along up.
+    void basis(Vec3f& forward, Vec3f& right, Vec3f& trueUp) const {
+        forward = (target - position).normalized();
+        right = forward.cross(up);
+        if (right.lengthSquared() < 1e-12f) right = forward.cross(Vec3f(0, 0, 1));
+        right = right.normalized();
+        trueUp = right.cross(forward);
+    }
+};
+
+/// @brief Sparse 3D voxel grid whose objects are the voxels of a BrickMap3.
+/// @details Objects sit at integer cells, one per cell, and an object's ID is its packed cell coordinate
+/// (BrickMap3::key, so cells within +-2^20 on each axis). Positions are derived from IDs and range queries walk
+/// the bricks, so the brick store is the only per-voxel state: about 4.2 bytes per voxel. Positions passed in
+/// are floored to their cell; adding into an occupied cell recolors it, and moving an object onto another
+/// replaces it.
 class Grid3 {
 protected:
-    //all positions
-    reverselookupassistant3 Positions;
-    std::unordered_map<size_t, GenericVoxel> Pixels;
-    
-    std::vector<size_t> unassignedIDs;
-    
+    //voxel colors by integer cell; one voxel per cell
+    BrickMap3 voxels;
+
     float neighborRadius = 1.0f;
-    
-    SpatialGrid3 spatialGrid;
-    float spatialCellSize = neighborRadius * 1.5f;
 
     // Default background color for empty spaces
     Vec4ui8 defaultBackgroundColor = Vec4ui8(0, 0, 0, 0);
     PNoise2 noisegen;
 
     bool regenpreventer = false;
+
+    //axis-aligned bounds of all objects, grown on insert and recomputed lazily once a boundary point leaves
+    mutable bool boundsValid = false;
+    mutable Vec3f boundsMin;
+    mutable Vec3f boundsMax;
+
+    void growBounds(const Vec3f& pos) {
+        if (!boundsValid) return;
+        boundsMin.x = std::min(boundsMin.x, pos.x);
+        boundsMin.y = std::min(boundsMin.y, pos.y);
+        boundsMin.z = std::min(boundsMin.z, pos.z);
+        boundsMax.x = std::max(boundsMax.x, pos.x);
+        boundsMax.y = std::max(boundsMax.y, pos.y);
+        boundsMax.z = std::max(boundsMax.z, pos.z);
+    }
+
+    /// @brief Called when an object leaves pos; only a point on the boundary can shrink the bounds.
+    void shrinkBounds(const Vec3f& pos) {
+        if (boundsValid && (pos.x == boundsMin.x || pos.y == boundsMin.y || pos.z == boundsMin.z ||
+                            pos.x == boundsMax.x || pos.y == boundsMax.y || pos.z == boundsMax.z)) {
+            boundsValid = false;
+        }
+    }
+
+    static Vec3f toPosition(const Vec3i& cell) {
+        return Vec3f(cell.x, cell.y, cell.z);
+    }
+
+    /// @brief Cell of an ID that must hold an object.
+    /// @throws std::out_of_range If it does not.
+    Vec3i occupiedCell(size_t id) const {
+        Vec3i cell = cellOfID(id);
+        if (!voxels.contains(cell)) throw std::out_of_range("unknown voxel ID");
+        return cell;
+    }
+
+    //dense table of the store's brick slots over their bounding box, so ray steps index an array instead of
+    //hashing; rebuilt only when bricks are allocated or freed
+    struct RenderVolume {
+        static constexpr int BRICK = Chunk3::SIZE;
+        static constexpr uint32_t EMPTY = BrickMap3::NONE;
+        uint64_t version = std::numeric_limits<uint64_t>::max();
+        //integer voxel coordinate of brick (0, 0, 0)
+        Vec3i origin;
+        //size of the brick table in bricks
+        Vec3i bricks;
+        std::vector<uint32_t> table;
+
+        uint32_t slotAt(int bx, int by, int bz) const {
+            return table[(static_cast<size_t>(bz) * bricks.y + by) * bricks.x + bx];
+        }
+    };
+    mutable RenderVolume renderVolume;
+
+    void buildRenderVolume() const {
+        TIME_FUNCTION;
+        RenderVolume& volume = renderVolume;
+        volume.version = voxels.version();
+        volume.table.clear();
+        if (voxels.brickCount() == 0) {
+            volume.bricks = Vec3i(0, 0, 0);
+            return;
+        }
+        Vec3i lo(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+        Vec3i hi(std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+        voxels.forEachBrick([&](uint32_t, const Vec3i& b, const Chunk3&) {
+            lo = lo.min(b);
+            hi = hi.max(b);
+        });
+        const int B = RenderVolume::BRICK;
+        volume.origin = Vec3i(lo.x * B, lo.y * B, lo.z * B);
+        volume.bricks = Vec3i(hi.x - lo.x + 1, hi.y - lo.y + 1, hi.z - lo.z + 1);
+        volume.table.assign(static_cast<size_t>(volume.bricks.x) * volume.bricks.y * volume.bricks.z, RenderVolume::EMPTY);
+        voxels.forEachBrick([&](uint32_t slot, const Vec3i& b, const Chunk3&) {
+            volume.table[(static_cast<size_t>(b.z - lo.z) * volume.bricks.y + (b.y - lo.y)) * volume.bricks.x + (b.x - lo.x)] = slot;
+        });
+    }
+
+    /// @brief Amanatides-Woo traversal of a grid of unit cells [0, size) along o + t * d for t in [t0, t1].
+    /// @details Calls visit(cell, tEnter, tExit, axis) per cell in order, where axis is the one crossed to
+    /// enter it (-1 for the first cell); stops early when visit returns true.
+    /// @return true if a visit stopped the traversal.
+    template<typename Func>
+    static bool traverseCells(const Vec3f& o, const Vec3f& d, float t0, float t1, const Vec3i& size, Func&& visit) {
+        if (t0 > t1) return false;
+        Vec3f start = o + d * t0;
+        int cell[3];
+        int step[3];
+        float tMax[3];
+        float tDelta[3];
+        for (int a = 0; a < 3; ++a) {
+            cell[a] = std::clamp(static_cast<int>(std::floor(start[a])), 0, size[a] - 1);
+            if (d[a] > 0.0f) {
+                step[a] = 1;
+                tDelta[a] = 1.0f / d[a];
+                tMax[a] = (cell[a] + 1 - o[a]) / d[a];
+            } else if (d[a] < 0.0f) {
+                step[a] = -1;
+                tDelta[a] = -1.0f / d[a];
+                tMax[a] = (cell[a] - o[a]) / d[a];
+            } else {
+                step[a] = 0;
+                tDelta[a] = std::numeric_limits<float>::max();
+                tMax[a] = std::numeric_limits<float>::max();
+            }
+        }
+        float t = t0;
+        int axis = -1;
+        while (t <= t1) {
+            int next = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+            float tExit = std::min(tMax[next], t1);
+            if (visit(Vec3i(cell[0], cell[1], cell[2]), t, tExit, axis)) return true;
+            cell[next] += step[next];
+            if (cell[next] < 0 || cell[next] >= size[next]) return false;
+            t = tMax[next];
+            tMax[next] += tDelta[next];
+            axis = next;
+        }
+        return false;
+    }
+
+    /// @brief Slab test of o + t * d against [lo, hi]; narrows t0/t1 and returns false on a miss.
+    static bool clipRay(const Vec3f& o, const Vec3f& d, const Vec3f& lo, const Vec3f& hi, float& t0, float& t1) {
+        for (int a = 0; a < 3; ++a) {
+            if (d[a] == 0.0f) {
+                if (o[a] < lo[a] || o[a] > hi[a]) return false;
+                continue;
+            }
+            float ta = (lo[a] - o[a]) / d[a];
+            float tb = (hi[a] - o[a]) / d[a];
+            if (ta > tb) std::swap(ta, tb);
+            t0 = std::max(t0, ta);
+            t1 = std::min(t1, tb);
+        }
+        return t0 <= t1;
+    }
+
+    /// @brief Casts one ray through the brick volume, restricted to the voxel box [lo, hi].
+    /// @return true on a hit, with the voxel color and the axis of the face that was hit.
+    bool castRay(const Vec3f& origin, const Vec3f& dir, const Vec3f& lo, const Vec3f& hi, Vec4ui8& color, int& face) const {
+        const RenderVolume& volume = renderVolume;
+        const int B = RenderVolume::BRICK;
+        Vec3f o = origin - Vec3f(volume.origin.x, volume.origin.y, volume.origin.z);
+        Vec3f volumeHi(volume.bricks.x * B, volume.bricks.y * B, volume.bricks.z * B);
+        float t0 = 0.0f;
+        float t1 = std::numeric_limits<float>::max();
+        if (!clipRay(o, dir, lo - Vec3f(volume.origin.x, volume.origin.y, volume.origin.z),
+                     hi - Vec3f(volume.origin.x, volume.origin.y, volume.origin.z), t0, t1)) return false;
+        if (!clipRay(o, dir, Vec3f(0, 0, 0), volumeHi, t0, t1)) return false;
+
+        // outer walk over bricks (brick units), inner walk over the voxels of each occupied brick
+        Vec3f ob = o / static_cast<float>(B);
+        Vec3i brickSize = volume.bricks;
+        return traverseCells(ob, dir / static_cast<float>(B), t0, t1, brickSize, [&](const Vec3i& b, float tIn, float tOut, int axisIn) {
+            uint32_t slot = volume.slotAt(b.x, b.y, b.z);
+            if (slot == RenderVolume::EMPTY) return false;
+            const Chunk3& brick = voxels.brick(slot);
+            Vec3f local = o - Vec3f(b.x * B, b.y * B, b.z * B);
+            return traverseCells(local, dir, tIn, tOut, Vec3i(B, B, B), [&](const Vec3i& v, float, float, int axis) {
+                int index = Chunk3::index(v.x, v.y, v.z);
+                if (!brick.has(index)) return false;
+                color = brick.colors[index];
+                face = axis >= 0 ? axis : axisIn;
+                return true;
+            });
+        });
+    }
+
 public:
+    static size_t frameChannels(frame::colormap format) {
+        switch (format) {
+            case frame::colormap::RGBA:
+            case frame::colormap::BGRA: return 4;
+            case frame::colormap::B: return 1;
+            default: return 3;
+        }
+    }
+
+    /// @brief Writes a 0-255 color into one pixel of a buffer in the given channel layout.
+    static void writePixel(uint8_t* out, const Vec4ui8& color, frame::colormap format) {
+        switch (format) {
+            case frame::colormap::RGBA:
+                out[0] = color.r; out[1] = color.g; out[2] = color.b; out[3] = color.a;
+                break;
+            case frame::colormap::BGR:
+                out[0] = color.b; out[1] = color.g; out[2] = color.r;
+                break;
+            case frame::colormap::BGRA:
+                out[0] = color.b; out[1] = color.g; out[2] = color.r; out[3] = color.a;
+                break;
+            case frame::colormap::B:
+                out[0] = (color.r + color.g + color.b) / 3;
+                break;
+            case frame::colormap::RGB:
+            default:
+                out[0] = color.r; out[1] = color.g; out[2] = color.b;
+                break;
+        }
+    }
 
     Grid3& noiseGenGrid(Vec3f min, Vec3f max, float minChance = 0.1f
                         , float maxChance = 1.0f, bool color = true, int noisemod = 42) {
@@ -348,97 +1088,144 @@ public:
         noisegen = PNoise2(noisemod);
         std::cout << "generating a noise grid with the following: "<< min << " by  " << max << "chance min: " << minChance 
                 << " max: " << maxChance << " gen colors: " << color << std::endl;
-        std::vector<Vec3f> poses;
-        std::vector<Vec4ui8> colors;
-        #pragma omp parallel for
-        for (int x = min.x; x < max.x; x++) {
-            #pragma omp parallel for
-            for (int y = min.y; y < max.y; y++) {
-                #pragma omp parallel for
-                for (int z = min.z; z < max.z; z++) {
-                    float nx = (x+noisemod)/(max.x+EPSILON)/0.1;
-                    float ny = (y+noisemod)/(max.y+EPSILON)/0.1;
-                    float nz = (z+noisemod)/(max.z+EPSILON)/0.1;
-                    Vec3 pos = Vec3f(nx,ny,nz);
-                    float alpha = noisegen.permute(pos);
-                    if (alpha > minChance && alpha < maxChance) {
-                        if (color) {
-                            float red = noisegen.permute(Vec3f(nx, ny, nz)*0.3);
-                            float green = noisegen.permute(Vec3f(nx, ny, nz)*0.6);
-                            float blue = noisegen.permute(Vec3f(nx, ny, nz)*0.9);
-                            Vec4 newc = Vec4ui8(red,green,blue,1.0);
-                            #pragma omp critical
-                            colors.push_back(newc);
-                            #pragma omp critical
-                            poses.push_back(Vec3f(x,y,z));
-                        } else {
-                            Vec4 newc = Vec4ui8(alpha,alpha,alpha,1.0);
-                            #pragma omp critical
-                            colors.push_back(newc);
-                            #pragma omp critical
-                            poses.push_back(Vec3f(x,y,z));
-                        }
-                    }
+        if (max.x <= min.x || max.y <= min.y || max.z <= min.z) return *this;
+        int minx = min.x, miny = min.y, minz = min.z;
+        size_t width = static_cast<int>(max.x) - minx;
+        size_t height = static_cast<int>(max.y) - miny;
+        size_t depth = static_cast<int>(max.z) - minz;
+
+        // one task per x slab; each slab samples whole z rows at once into slab-local buffers
+        struct Slab {
+            std::vector<Vec3f> poses;
+            std::vector<Vec4ui8> colors;
+        };
+        std::vector<Slab> slabs(width);
+        std::vector<size_t> slabIndex(width);
+        std::iota(slabIndex.begin(), slabIndex.end(), 0);
+        std::for_each(std::execution::par, slabIndex.begin(), slabIndex.end(), [&](size_t i) {
+            int x = minx + static_cast<int>(i);
+            Slab& slab = slabs[i];
+            std::vector<float> nx(depth, (x+noisemod)/(max.x+EPSILON)/0.1);
+            std::vector<float> ny(depth);
+            std::vector<float> nz(depth);
+            for (size_t k = 0; k < depth; ++k) {
+                nz[k] = (minz+static_cast<int>(k)+noisemod)/(max.z+EPSILON)/0.1;
+            }
+            std::vector<float> alpha(depth);
+            std::vector<size_t> keep;
+            std::vector<float> kx, ky, kz, red, green, blue;
+            for (size_t j = 0; j < height; ++j) {
+                int y = miny + static_cast<int>(j);
+                std::fill(ny.begin(), ny.end(), (y+noisemod)/(max.y+EPSILON)/0.1);
+                noisegen.sampleBatch(nx.data(), ny.data(), nz.data(), alpha.data(), depth);
+
+                // compact the kept samples so the color passes only evaluate those
+                keep.clear();
+                for (size_t k = 0; k < depth; ++k) {
+                    if (alpha[k] > minChance && alpha[k] < maxChance) keep.push_back(k);
+                }
+                size_t kept = keep.size();
+                if (kept == 0) continue;
+                for (size_t k : keep) slab.poses.push_back(Vec3f(x, y, minz+static_cast<int>(k)));
+                if (!color) {
+                    for (size_t k : keep) slab.colors.push_back(Vec4ui8(alpha[k],alpha[k],alpha[k],1.0));
+                    continue;
+                }
+                kx.assign(kept, nx[0]);
+                ky.assign(kept, ny[0]);
+                kz.resize(kept);
+                for (size_t k = 0; k < kept; ++k) kz[k] = nz[keep[k]];
+                red.resize(kept);
+                green.resize(kept);
+                blue.resize(kept);
+                noisegen.sampleBatch(kx.data(), ky.data(), kz.data(), red.data(), kept, 0.3f);
+                noisegen.sampleBatch(kx.data(), ky.data(), kz.data(), green.data(), kept, 0.6f);
+                noisegen.sampleBatch(kx.data(), ky.data(), kz.data(), blue.data(), kept, 0.9f);
+                for (size_t k = 0; k < kept; ++k) {
+                    slab.colors.push_back(Vec4ui8(red[k],green[k],blue[k],1.0));
                 }
             }
+        });
+
+        std::vector<Vec3f> poses;
+        std::vector<Vec4ui8> colors;
+        size_t total = 0;
+        for (const Slab& slab : slabs) total += slab.poses.size();
+        poses.reserve(total);
+        colors.reserve(total);
+        for (const Slab& slab : slabs) {
+            poses.insert(poses.end(), slab.poses.begin(), slab.poses.end());
+            colors.insert(colors.end(), slab.colors.begin(), slab.colors.end());
         }
         std::cout << "noise generated" << std::endl;
         bulkAddObjects(poses,colors);
         return *this;
     }
 
+    /// @brief The ID of the object in a cell.
+    static size_t idOf(const Vec3i& cell) {
+        return BrickMap3::key(cell);
+    }
+
+    /// @brief The cell an ID names.
+    static Vec3i cellOfID(size_t id) {
+        return BrickMap3::unkey(id);
+    }
+
+    /// @brief Adds an object in the cell containing pos, or recolors the one already there.
+    /// @return The cell's ID.
     size_t addObject(const Vec3f& pos, const Vec4ui8& color, float size = 1.0f) {
-        size_t id = Positions.set(pos);
-        Pixels.emplace(id, GenericVoxel(id, color, pos));
-        spatialGrid.insert(id, pos);
-        return id;
+        Vec3i cell = BrickMap3::cellOf(pos);
+        if (voxels.set(cell, color)) growBounds(toPosition(cell));
+        return idOf(cell);
     }
 
     /// @brief Sets the default background color.
     void setDefault(const Vec4ui8& color) {
         defaultBackgroundColor = color;
     }
-    
-    /// @brief Moves an object to a new position and updates spatial indexing.
-    void setPosition(size_t id, const Vec3f& newPosition) {
-        Vec3f oldPosition = Positions.at(id);
-        Pixels.at(id).move(newPosition);
-        spatialGrid.update(id, oldPosition, newPosition);
-        Positions.at(id).move(newPosition);
+
+    /// @brief Moves an object to the cell containing newPosition, replacing any object there.
+    /// @return The object's new ID.
+    /// @throws std::out_of_range If id holds no object.
+    size_t setPosition(size_t id, const Vec3f& newPosition) {
+        Vec3i oldCell = occupiedCell(id);
+        Vec3i newCell = BrickMap3::cellOf(newPosition);
+        if (oldCell == newCell) return id;
+        Vec4ui8 color;
+        voxels.get(oldCell, color);
+        voxels.erase(oldCell);
+        voxels.set(newCell, color);
+        shrinkBounds(toPosition(oldCell));
+        growBounds(toPosition(newCell));
+        return idOf(newCell);
     }
-    
+
+    /// @throws std::out_of_range If id holds no object.
     void setColor(size_t id, const Vec4ui8 color) {
-        Pixels.at(id).recolor(color);
+        voxels.set(occupiedCell(id), color);
     }
-    
+
     void setNeighborRadius(float radius) {
         neighborRadius = radius;
-        //optimizeSpatialGrid();
     }
-    
+
     Vec4ui8 getDefaultBackgroundColor() const {
         return defaultBackgroundColor;
     }
 
+    /// @throws std::out_of_range If id holds no object.
     Vec3f getPositionID(size_t id) const {
-        Vec3f it = Positions.at(id);
-        return it;
+        return toPosition(occupiedCell(id));
     }
 
+    /// @brief The object in the cell containing pos, or the first within radius of pos.
+    /// @return Its ID, or SIZE_MAX if there is none.
     size_t getPositionVec(const Vec3f& pos, float radius = 0.0f) const {
         TIME_FUNCTION;
         if (radius == 0.0f) {
-            // Exact match - use spatial grid to find the cell
-            Vec3f gridPos = spatialGrid.worldToGrid(pos);
-            auto cellIt = spatialGrid.grid.find(gridPos);
-            if (cellIt != spatialGrid.grid.end()) {
-                for (size_t id : cellIt->second) {
-                    if (Positions.at(id) == pos) {
-                        return id;
-                    }
-                }
-            }
-            return -1;
+            Vec3i cell = BrickMap3::cellOf(pos);
+            return voxels.contains(cell) ? idOf(cell) : std::numeric_limits<size_t>::max();
         } else {
             auto results = getPositionVecRegion(pos, radius);
             if (!results.empty()) {
@@ -451,15 +1238,8 @@ public:
     size_t getOrCreatePositionVec(const Vec3f& pos, float radius = 0.0f, bool create = true) {
         //TIME_FUNCTION; //called too many times and average time is less than 0.0000001 so ignore it.
         if (radius == 0.0f) {
-            Vec3f gridPos = spatialGrid.worldToGrid(pos);
-            auto cellIt = spatialGrid.grid.find(gridPos);
-            if (cellIt != spatialGrid.grid.end()) {
-                for (size_t id : cellIt->second) {
-                    if (Positions.at(id) == pos) {
-                        return id;
-                    }
-                }
-            }
+            Vec3i cell = BrickMap3::cellOf(pos);
+            if (voxels.contains(cell)) return idOf(cell);
             if (create) {
                 return addObject(pos, defaultBackgroundColor, 1.0f);
             }
@@ -478,54 +1258,100 @@ public:
 
     std::vector<size_t> getPositionVecRegion(const Vec3f& pos, float radius = 1.0f) const {
         //TIME_FUNCTION;
-        float searchRadius = (radius == 0.0f) ? std::numeric_limits<float>::epsilon() : radius;
-        
-        // Get candidates from spatial grid
-        std::vector<size_t> candidates = spatialGrid.queryRange(pos, searchRadius);
-        
-        // Fine-filter by exact distance
         std::vector<size_t> results;
-        float radiusSq = searchRadius * searchRadius;
-        
-        for (size_t id : candidates) {
-            if (Positions.at(id).distanceSquared(pos) <= radiusSq) {
-                results.push_back(id);
-            }
-        }
-        
+        forEachInRadius(pos, radius, [&](size_t id) {
+            results.push_back(id);
+        });
         return results;
     }
 
-    Vec4ui8 getColor(size_t id) {
-        return Pixels.at(id).getColor();
+    /// @brief Calls fn(id) for every voxel within radius of a position, without building a container.
+    /// @details Walks the bricks overlapping the query box and tests their occupancy directly.
+    /// @param radius If 0.0, only a voxel exactly at pos is visited.
+    template<typename Func>
+    void forEachInRadius(const Vec3f& pos, float radius, Func&& fn) const {
+        float radiusSq = radius * radius;
+        Vec3i lo(static_cast<int>(std::ceil(pos.x - radius)), static_cast<int>(std::ceil(pos.y - radius)), static_cast<int>(std::ceil(pos.z - radius)));
+        Vec3i hi(static_cast<int>(std::floor(pos.x + radius)), static_cast<int>(std::floor(pos.y + radius)), static_cast<int>(std::floor(pos.z + radius)));
+        voxels.forEachInBox(lo, hi, [&](const Vec3i& cell, const Vec4ui8&) {
+            if (toPosition(cell).distanceSquared(pos) <= radiusSq) fn(idOf(cell));
+        });
+    }
+
+    /// @brief Calls fn(neighborId) for every voxel within radius of the given ID, excluding the ID itself.
+    /// @details Candidates are filtered in place, nothing is allocated. The functor must not add, remove or move voxels.
+    template<typename Func>
+    void forEachNeighbor(size_t id, float radius, Func&& fn) const {
+        Vec3f pos = getPositionID(id);
+        forEachInRadius(pos, radius, [&](size_t candidateId) {
+            if (candidateId != id) fn(candidateId);
+        });
+    }
+
+    /// @brief Calls fn(neighborId) for every voxel within `neighborRadius` of the given ID.
+    template<typename Func>
+    void forEachNeighbor(size_t id, Func&& fn) const {
+        forEachNeighbor(id, neighborRadius, fn);
+    }
+
+    /// @throws std::out_of_range If id holds no object.
+    Vec4ui8 getColor(size_t id) const {
+        Vec4ui8 color;
+        if (!voxels.get(cellOfID(id), color)) throw std::out_of_range("unknown voxel ID");
+        return color;
+    }
+
+    /// @brief The brick store holding every voxel's color, for renderers and exporters that walk it directly.
+    const BrickMap3& getVoxels() const {
+        return voxels;
     }
 
+    /// @brief Returns the axis-aligned bounding box of all objects in the grid.
+    /// @details Kept up to date on insert and move; a full scan only happens after a boundary point left.
     std::pair<Vec3f,Vec3f> getBoundingBox(Vec3f& minCorner, Vec3f& maxCorner) const {
-        TIME_FUNCTION;
-        if (Positions.empty()) {
-            std::cout << "empty" << std::endl;
+        if (voxels.empty()) {
             minCorner = Vec3f(0, 0, 0);
             maxCorner = Vec3f(0, 0, 0);
+            return std::make_pair(minCorner, maxCorner);
         }
-        
-        // Initialize with first position
-        auto it = Positions.begin();
-        minCorner = it->second;
-        maxCorner = it->second;
-        
-        // Find min and max coordinates
-        for (const auto& [id, pos] : Positions) {
-            minCorner.x = std::min(minCorner.x, pos.x);
-            minCorner.y = std::min(minCorner.y, pos.y);
-            minCorner.z = std::min(minCorner.z, pos.z);
-            maxCorner.x = std::max(maxCorner.x, pos.x);
-            maxCorner.y = std::max(maxCorner.y, pos.y);
-            maxCorner.z = std::max(maxCorner.z, pos.z);
-        }
-        // std::cout << "bounding box: " << minCorner << ", " << maxCorner << std::endl;
+        if (!boundsValid) {
+            computeBoundingBox(boundsMin, boundsMax);
+            boundsValid = true;
+        }
+        minCorner = boundsMin;
+        maxCorner = boundsMax;
         return std::make_pair(minCorner, maxCorner);
     }
 
+    /// @brief Scans every object for the axis-aligned bounding box.
+    /// @details Bricks strictly inside the running bounds are skipped without reading their voxels.
+    void computeBoundingBox(Vec3f& minCorner, Vec3f& maxCorner) const {
+        TIME_FUNCTION;
+        const int B = Chunk3::SIZE;
+        Vec3i lo(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+        Vec3i hi(std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+        voxels.forEachBrick([&](uint32_t, const Vec3i& b, const Chunk3& chunk) {
+            Vec3i first(b.x * B, b.y * B, b.z * B);
+            Vec3i last(first.x + B - 1, first.y + B - 1, first.z + B - 1);
+            if (first.x > lo.x && first.y > lo.y && first.z > lo.z && last.x < hi.x && last.y < hi.y && last.z < hi.z) return;
+            chunk.forEach([&](int local, const Vec4ui8&) {
+                Vec3i offset = Chunk3::cellOf(local);
+                Vec3i cell(first.x + offset.x, first.y + offset.y, first.z + offset.z);
+                lo = lo.min(cell);
+                hi = hi.max(cell);
+            });
+        });
+        minCorner = toPosition(lo);
+        maxCorner = toPosition(hi);
+    }
+
+    /// @brief Splats the voxels inside [minCorner, maxCorner] straight onto the frame, a fast preview path.
+    /// @details Each voxel (at its integer cell, read straight from the brick store) is projected along
+    /// View.direction onto the world x/y plane, scaled so the region fills the frame, and the nearest voxel
+    /// per pixel wins. Depth is the distance along View.direction, or z when it is zero.
+    /// Bricks are binned by the bands of pixel rows their projected bounds cover, then the bands splat in
+    /// parallel into one shared depth buffer, each writing only its own rows. A brick spanning several bands
+    /// is visited once per band. Ties keep the earliest brick, so the image does not depend on the thread count.
     frame getGridRegionAsFrame(const Vec3f& minCorner, const Vec3f& maxCorner, const Vec2& res,
                             const Ray3<float>& View, frame::colormap outChannels = frame::colormap::RGB) const {
         TIME_FUNCTION;
@@ -544,177 +1370,198 @@ public:
             outframe.colorFormat = outChannels;
             return outframe;
         }
-        
-        frame outframe(outputWidth, outputHeight, outChannels);
-        
-        std::unordered_map<Vec2, Vec4ui8> colorBuffer;
-        std::unordered_map<Vec2, Vec4ui8> colorAccumBuffer;
-        std::unordered_map<Vec2, int> countBuffer;
-        std::unordered_map<Vec2, float> depthBuffer;
-        
-        size_t bufferSize = outputWidth * outputHeight;
-        colorBuffer.reserve(bufferSize);
-        colorAccumBuffer.reserve(bufferSize);
-        countBuffer.reserve(bufferSize);
-        depthBuffer.reserve(bufferSize);
-        
-        Vec3f viewDirection = View.direction;
+        const int B = Chunk3::SIZE;
+
         Vec3f viewOrigin = View.origin;
-        
-        Vec3f viewRight = Vec3f(1, 0, 0);
-        Vec3f viewUp = Vec3f(0, 1, 0);
-        
+        Vec3f viewDirection = View.direction;
+        bool alongView = viewDirection.lengthSquared() > 0.0f;
+        if (alongView) viewDirection = viewDirection.normalized();
         float xScale = outputWidth / width;
         float yScale = outputHeight / height;
-        
-        size_t voxelCount = 0;
-        
-        for (const auto& [id, pos] : Positions) {
-            if (pos.x >= minCorner.x && pos.x <= maxCorner.x &&
-                pos.y >= minCorner.y && pos.y <= maxCorner.y &&
-                pos.z >= minCorner.z && pos.z <= maxCorner.z) {
-                
-                voxelCount++;
-                
-                float relX = pos.x - minCorner.x;
-                float relY = pos.y - minCorner.y;
-                float relZ = pos.z - minCorner.z;
-                
-                Vec3f toVoxel = pos - viewOrigin;
-                float distance = toVoxel.length();
-                
-                Vec3f viewPlanePos = pos - (toVoxel.dot(viewDirection)) * viewDirection;
-                
-                float screenX = viewPlanePos.dot(viewRight);
-                float screenY = viewPlanePos.dot(viewUp);
-                
-                int pixX = static_cast<int>((screenX - minCorner.x) * xScale);
-                int pixY = static_cast<int>((screenY - minCorner.y) * yScale);
-                
-                pixX = std::max(0, std::min(pixX, static_cast<int>(outputWidth) - 1));
-                pixY = std::max(0, std::min(pixY, static_cast<int>(outputHeight) - 1));
-                
-                Vec2 pixelPos(pixX, pixY);
-        
-                Vec4ui8 voxelColor = Pixels.at(id).getColor();
-                
-                float depth = relZ;
-                
-                
-                bool shouldRender = true;
-                auto depthIt = depthBuffer.find(pixelPos);
-                if (depthIt != depthBuffer.end()) {
-                    if (depth > depthIt->second) {
-                        shouldRender = false;
-                    } else {
-                        depthBuffer[pixelPos] = depth;
-                    }
-                } else {
-                    depthBuffer[pixelPos] = depth;
-                }
-                
-                if (shouldRender) {
-                    colorAccumBuffer[pixelPos] += voxelColor;
-                    countBuffer[pixelPos]++;
-                    
-                    colorBuffer[pixelPos] = voxelColor;
-                }
+        // integer cells whose position lies inside the region
+        Vec3i lo(static_cast<int>(std::ceil(minCorner.x)), static_cast<int>(std::ceil(minCorner.y)), static_cast<int>(std::ceil(minCorner.z)));
+        Vec3i hi(static_cast<int>(std::floor(maxCorner.x)), static_cast<int>(std::floor(maxCorner.y)), static_cast<int>(std::floor(maxCorner.z)));
+
+        auto project = [&](const Vec3f& pos, float& screenX, float& screenY, float& voxelDepth) {
+            screenX = pos.x;
+            screenY = pos.y;
+            voxelDepth = pos.z - minCorner.z;
+            if (alongView) {
+                voxelDepth = (pos - viewOrigin).dot(viewDirection);
+                Vec3f viewPlanePos = pos - viewDirection * voxelDepth;
+                screenX = viewPlanePos.x;
+                screenY = viewPlanePos.y;
             }
+        };
+        auto pixelRow = [&](float screenY) {
+            return std::clamp(static_cast<int>((screenY - minCorner.y) * yScale), 0, static_cast<int>(outputHeight) - 1);
+        };
+
+        // pass 1: the rows each brick can land on; the projection is affine, so its clipped corners bound it
+        size_t slotCount = voxels.slotCount();
+        std::vector<int> rowLo(slotCount, 0);
+        std::vector<int> rowHi(slotCount, -1);
+        std::vector<size_t> slots(slotCount);
+        std::iota(slots.begin(), slots.end(), 0);
+        std::for_each(std::execution::par, slots.begin(), slots.end(), [&](size_t slot) {
+            const Chunk3& brick = voxels.brick(static_cast<uint32_t>(slot));
+            const Vec3i& coord = voxels.brickCoord(static_cast<uint32_t>(slot));
+            Vec3i first(std::max(coord.x * B, lo.x), std::max(coord.y * B, lo.y), std::max(coord.z * B, lo.z));
+            Vec3i last(std::min(coord.x * B + B - 1, hi.x), std::min(coord.y * B + B - 1, hi.y), std::min(coord.z * B + B - 1, hi.z));
+            if (brick.empty() || first.x > last.x || first.y > last.y || first.z > last.z) return;
+            int top = std::numeric_limits<int>::max();
+            int bottom = std::numeric_limits<int>::min();
+            for (int corner = 0; corner < 8; ++corner) {
+                Vec3f pos(corner & 1 ? last.x : first.x, corner & 2 ? last.y : first.y, corner & 4 ? last.z : first.z);
+                float screenX, screenY, voxelDepth;
+                project(pos, screenX, screenY, voxelDepth);
+                top = std::min(top, pixelRow(screenY));
+                bottom = std::max(bottom, pixelRow(screenY));
+            }
+            // one row of slack for rounding between the corner and per-voxel projections
+            rowLo[slot] = std::max(top - 1, 0);
+            rowHi[slot] = std::min(bottom + 1, static_cast<int>(outputHeight) - 1);
+        });
+
+        // bin bricks into bands of rows (counting sort), keeping slot order within each band
+        size_t bandCount = std::clamp<size_t>(std::thread::hardware_concurrency() * 4, 1, outputHeight);
+        size_t bandRows = (outputHeight + bandCount - 1) / bandCount;
+        bandCount = (outputHeight + bandRows - 1) / bandRows;
+        std::vector<size_t> bandStart(bandCount + 1, 0);
+        // skipped bricks have rowHi < rowLo; -1 / bandRows truncates to 0, so test explicitly
+        for (size_t slot = 0; slot < slotCount; ++slot) {
+            if (rowHi[slot] < rowLo[slot]) continue;
+            for (int band = rowLo[slot] / bandRows; band <= rowHi[slot] / static_cast<int>(bandRows); ++band) bandStart[band + 1]++;
         }
-        
-        switch (outChannels) {
-            case frame::colormap::RGBA: {
-                std::vector<uint8_t> pixelBuffer(outputWidth * outputHeight * 4, 0);        
-                for (size_t y = 0; y < outputHeight; ++y) {
-                    for (size_t x = 0; x < outputWidth; ++x) {
-                        Vec2 pixelPos(x, y);
-                        size_t index = (y * outputWidth + x) * 4;
-                        
-                        Vec4ui8 finalColor;
-                        auto countIt = countBuffer.find(pixelPos);
-                        
-                        if (countIt != countBuffer.end() && countIt->second > 0) {
-                            finalColor = colorAccumBuffer[pixelPos] / static_cast<float>(countIt->second);
-                            finalColor = finalColor.clamp(0.0f, 1.0f);
-                            finalColor = finalColor * 255.0f;
-                        } else {
-                            finalColor = defaultBackgroundColor * 255.0f;
-                        }
-                        
-                        pixelBuffer[index + 0] = static_cast<uint8_t>(finalColor.r);
-                        pixelBuffer[index + 1] = static_cast<uint8_t>(finalColor.g);
-                        pixelBuffer[index + 2] = static_cast<uint8_t>(finalColor.b);
-                        pixelBuffer[index + 3] = static_cast<uint8_t>(finalColor.a);
-                    }
-                }
-                
-                outframe.setData(pixelBuffer);
-                break;
+        std::partial_sum(bandStart.begin(), bandStart.end(), bandStart.begin());
+        std::vector<uint32_t> bandSlots(bandStart.back());
+        std::vector<size_t> fill(bandStart.begin(), bandStart.end() - 1);
+        for (size_t slot = 0; slot < slotCount; ++slot) {
+            if (rowHi[slot] < rowLo[slot]) continue;
+            for (int band = rowLo[slot] / bandRows; band <= rowHi[slot] / static_cast<int>(bandRows); ++band) {
+                bandSlots[fill[band]++] = static_cast<uint32_t>(slot);
             }
-                
-            case frame::colormap::BGR: {
-                std::vector<uint8_t> pixelBuffer(outputWidth * outputHeight * 3, 0);
-                
-                for (size_t y = 0; y < outputHeight; ++y) {
-                    for (size_t x = 0; x < outputWidth; ++x) {
-                        Vec2 pixelPos(x, y);
-                        size_t index = (y * outputWidth + x) * 3;
-                        
-                        Vec4ui8 finalColor;
-                        auto countIt = countBuffer.find(pixelPos);
-                        
-                        if (countIt != countBuffer.end() && countIt->second > 0) {
-                            finalColor = colorAccumBuffer[pixelPos] / static_cast<float>(countIt->second);
-                            finalColor = finalColor.clamp(0.0f, 1.0f);
-                            finalColor = finalColor * 255.0f;
-                        } else {
-                            finalColor = defaultBackgroundColor * 255.0f;
-                        }
-                        
-                        pixelBuffer[index + 2] = static_cast<uint8_t>(finalColor.r);
-                        pixelBuffer[index + 1] = static_cast<uint8_t>(finalColor.g);
-                        pixelBuffer[index + 0] = static_cast<uint8_t>(finalColor.b);
+        }
+
+        // pass 2: bands own disjoint rows of one shared depth buffer, so they splat without merging
+        struct Sample {
+            float depth = std::numeric_limits<float>::infinity();
+            Vec4ui8 color;
+        };
+        size_t pixelCount = outputWidth * outputHeight;
+        std::vector<Sample> samples(pixelCount);
+        std::vector<size_t> bands(bandCount);
+        std::iota(bands.begin(), bands.end(), 0);
+        std::for_each(std::execution::par, bands.begin(), bands.end(), [&](size_t band) {
+            int firstRow = static_cast<int>(band * bandRows);
+            int lastRow = static_cast<int>(std::min((band + 1) * bandRows, outputHeight)) - 1;
+            for (size_t k = bandStart[band]; k < bandStart[band + 1]; ++k) {
+                uint32_t slot = bandSlots[k];
+                const Vec3i& coord = voxels.brickCoord(slot);
+                int bx = coord.x * B;
+                int by = coord.y * B;
+                int bz = coord.z * B;
+                voxels.brick(slot).forEach([&](int local, const Vec4ui8& color) {
+                    Vec3f pos(bx + local % B, by + (local / B) % B, bz + local / (B * B));
+                    if (pos.x < lo.x || pos.y < lo.y || pos.z < lo.z || pos.x > hi.x || pos.y > hi.y || pos.z > hi.z) return;
+                    float screenX, screenY, voxelDepth;
+                    project(pos, screenX, screenY, voxelDepth);
+                    int pixY = pixelRow(screenY);
+                    if (pixY < firstRow || pixY > lastRow) return;
+                    int pixX = std::clamp(static_cast<int>((screenX - minCorner.x) * xScale), 0, static_cast<int>(outputWidth) - 1);
+                    Sample& sample = samples[pixY * outputWidth + pixX];
+                    if (voxelDepth < sample.depth) {
+                        sample.depth = voxelDepth;
+                        sample.color = color;
                     }
-                }
-                
-                outframe.setData(pixelBuffer);
-                break;
+                });
             }
-                
-            case frame::colormap::RGB:
-            default: {
-                std::vector<uint8_t> pixelBuffer(outputWidth * outputHeight * 3, 0);
-                
-                for (size_t y = 0; y < outputHeight; ++y) {
-                    for (size_t x = 0; x < outputWidth; ++x) {
-                        Vec2 pixelPos(x, y);
-                        size_t index = (y * outputWidth + x) * 3;
-                        
-                        Vec4ui8 finalColor;
-                        auto countIt = countBuffer.find(pixelPos);
-                        
-                        if (countIt != countBuffer.end() && countIt->second > 0) {
-                            finalColor = colorAccumBuffer[pixelPos] / static_cast<float>(countIt->second);
-                            finalColor = finalColor.clamp(0.0f, 1.0f);
-                            finalColor = finalColor * 255.0f;
-                        } else {
-                            finalColor = defaultBackgroundColor * 255.0f;
-                        }
-                        
-                        pixelBuffer[index + 0] = static_cast<uint8_t>(finalColor.r);
-                        pixelBuffer[index + 1] = static_cast<uint8_t>(finalColor.g);
-                        pixelBuffer[index + 2] = static_cast<uint8_t>(finalColor.b);
+        });
+
+        size_t channels = frameChannels(outChannels);
+        std::vector<uint8_t> pixels(pixelCount * channels);
+        std::vector<size_t> rows(outputHeight);
+        std::iota(rows.begin(), rows.end(), 0);
+        std::for_each(std::execution::par, rows.begin(), rows.end(), [&](size_t y) {
+            for (size_t i = y * outputWidth; i < (y + 1) * outputWidth; ++i) {
+                const Sample& sample = samples[i];
+                Vec4ui8 color = sample.depth < std::numeric_limits<float>::infinity() ? sample.color : defaultBackgroundColor;
+                writePixel(pixels.data() + i * channels, color, outChannels);
+            }
+        });
+
+        frame outframe(outputWidth, outputHeight, outChannels);
+        outframe.setData(std::move(pixels));
+        return outframe;
+    }
+
+    /// @brief Ray-casts the voxels inside [minCorner, maxCorner] from a perspective camera.
+    /// @details Voxels live in 8^3 bricks with occupancy masks (see BrickMap3) and every pixel walks them with a two-level Amanatides-Woo DDA: bricks first, then the voxels of each
+    /// occupied brick, so empty space costs one step per brick. Tiles of pixels are rendered in parallel.
+    /// Voxel colors are written as stored (0-255), with faces shaded per axis so depth reads; pixels that
+    /// hit nothing get the default background color.
+    frame getGridRegionAsFrame(const Vec3f& minCorner, const Vec3f& maxCorner, const Vec2& res,
+                               const Camera3& camera, frame::colormap outChannels = frame::colormap::RGB) const {
+        TIME_FUNCTION;
+        size_t outputWidth = static_cast<size_t>(res.x);
+        size_t outputHeight = static_cast<size_t>(res.y);
+        if (outputWidth == 0 || outputHeight == 0) {
+            frame outframe = frame();
+            outframe.colorFormat = outChannels;
+            return outframe;
+        }
+        if (renderVolume.version != voxels.version()) buildRenderVolume();
+
+        Vec3f forward, right, up;
+        camera.basis(forward, right, up);
+        float halfHeight = std::tan(camera.fov * 0.5f * static_cast<float>(M_PI) / 180.0f);
+        float halfWidth = halfHeight * outputWidth / static_cast<float>(outputHeight);
+        // voxels occupy [p, p + 1), so the box ends one past the last included voxel
+        Vec3f lo = minCorner.floor();
+        Vec3f hi = maxCorner.floor() + Vec3f(1, 1, 1);
+        const float shade[3] = {0.8f, 1.0f, 0.6f};
+
+        size_t channels = frameChannels(outChannels);
+        std::vector<uint8_t> pixels(outputWidth * outputHeight * channels);
+        constexpr size_t TILE = 16;
+        size_t tilesX = (outputWidth + TILE - 1) / TILE;
+        size_t tilesY = (outputHeight + TILE - 1) / TILE;
+        std::vector<size_t> tiles(tilesX * tilesY);
+        std::iota(tiles.begin(), tiles.end(), 0);
+        std::for_each(std::execution::par, tiles.begin(), tiles.end(), [&](size_t tile) {
+            size_t x0 = (tile % tilesX) * TILE;
+            size_t y0 = (tile / tilesX) * TILE;
+            for (size_t y = y0; y < std::min(y0 + TILE, outputHeight); ++y) {
+                float v = (1.0f - 2.0f * (y + 0.5f) / outputHeight) * halfHeight;
+                for (size_t x = x0; x < std::min(x0 + TILE, outputWidth); ++x) {
+                    float u = (2.0f * (x + 0.5f) / outputWidth - 1.0f) * halfWidth;
+                    Vec3f dir = (forward + right * u + up * v).normalized();
+                    Vec4ui8 color = defaultBackgroundColor;
+                    Vec4ui8 hit;
+                    int face;
+                    if (castRay(camera.position, dir, lo, hi, hit, face)) {
+                        float s = shade[face >= 0 ? face : 1];
+                        color = Vec4ui8(static_cast<uint8_t>(hit.r * s), static_cast<uint8_t>(hit.g * s),
+                                        static_cast<uint8_t>(hit.b * s), 255);
                     }
+                    writePixel(pixels.data() + (y * outputWidth + x) * channels, color, outChannels);
                 }
-                
-                outframe.setData(pixelBuffer);
-                break;
             }
-        }
-        
+        });
+
+        frame outframe(outputWidth, outputHeight, outChannels);
+        outframe.setData(std::move(pixels));
         return outframe;
     }
 
+    /// @brief Ray-casts the whole grid from a perspective camera.
+    frame getGridAsFrame(const Vec2& res, const Camera3& camera, frame::colormap outChannels = frame::colormap::RGB) const {
+        Vec3f Min;
+        Vec3f Max;
+        auto a = getBoundingBox(Min, Max);
+        return getGridRegionAsFrame(a.first, a.second, res, camera, outChannels);
+    }
+
     frame getGridAsFrame(const Vec2& res, const Ray3<float>& View, frame::colormap outChannels = frame::colormap::RGB) const {
         Vec3f Min;
         Vec3f Max;
@@ -723,48 +1570,50 @@ public:
         return getGridRegionAsFrame(a.first, a.second, res, View, outChannels);
     }
 
+    /// @throws std::out_of_range If id holds no object.
     size_t removeID(size_t id) {
-        Vec3f oldPosition = Positions.at(id);
-        Positions.remove(id);
-        Pixels.erase(id);
-        unassignedIDs.push_back(id);
-        spatialGrid.remove(id, oldPosition);
+        Vec3i cell = occupiedCell(id);
+        voxels.erase(cell);
+        shrinkBounds(toPosition(cell));
         return id;
     }
 
+    /// @brief Moves several objects at once; every color is read before any is written, so objects can trade cells.
+    /// @details Later entries win where two objects land in one cell. The objects' IDs change to their new cells.
     void bulkUpdatePositions(const std::unordered_map<size_t, Vec3f>& newPositions) {
         TIME_FUNCTION;
+        std::vector<std::pair<Vec3i, Vec4ui8>> moved;
+        moved.reserve(newPositions.size());
         for (const auto& [id, newPos] : newPositions) {
-            Vec3f oldPosition = Positions.at(id);
-            Positions.at(id).move(newPos);
-            Pixels.at(id).move(newPos);
-            spatialGrid.update(id, oldPosition, newPos);
+            Vec3i cell = occupiedCell(id);
+            Vec4ui8 color;
+            voxels.get(cell, color);
+            moved.emplace_back(BrickMap3::cellOf(newPos), color);
+        }
+        for (const auto& [id, newPos] : newPositions) {
+            Vec3i cell = cellOfID(id);
+            voxels.erase(cell);
+            shrinkBounds(toPosition(cell));
+        }
+        for (const auto& [cell, color] : moved) {
+            voxels.set(cell, color);
+            growBounds(toPosition(cell));
         }
     }
 
+    /// @brief Adds one object per position, as addObject() does.
+    /// @return The ID of each input point, in input order; points sharing a cell share its ID.
     std::vector<size_t> bulkAddObjects(const std::vector<Vec3f> poses, std::vector<Vec4ui8> colors) {
         TIME_FUNCTION;
         std::vector<size_t> ids;
         ids.reserve(poses.size());
-        
-        // Reserve space in maps to avoid rehashing
-        if (Positions.bucket_count() < Positions.size() + poses.size()) {
-            Positions.reserve(Positions.size() + poses.size());
-            Pixels.reserve(Positions.size() + poses.size());
-        }
-        
-        // Batch insertion
-        std::vector<size_t> newids;
         for (size_t i = 0; i < poses.size(); ++i) {
-            size_t id = Positions.set(poses[i]);
-            Pixels.emplace(id, GenericVoxel(id, colors[i], poses[i]));
-            spatialGrid.insert(id,poses[i]);
-            newids.push_back(id);
+            ids.push_back(addObject(poses[i], colors[i]));
         }
-        
+
         shrinkIfNeeded();
-        
-        return newids;
+
+        return ids;
     }
 
     void shrinkIfNeeded() {
@@ -772,60 +1621,24 @@ public:
     }
 
     void clear() {
-        Positions.clear();
-        Pixels.clear();
-        spatialGrid.clear();
-        Pixels.rehash(0);
+        voxels.clear();
+        boundsValid = false;
         defaultBackgroundColor = Vec4ui8(0, 0, 0, 0);
     }
 
-    void optimizeSpatialGrid() {
-        TIME_FUNCTION;
-        //std::cout << "optimizeSpatialGrid()" << std::endl;
-        spatialCellSize = neighborRadius * neighborRadius;
-        spatialGrid = SpatialGrid3(spatialCellSize);
-        
-        // Rebuild spatial grid
-        spatialGrid.clear();
-        for (const auto& [id, pos] : Positions) {
-            spatialGrid.insert(id, pos);
-        }
-    }
-
     std::vector<size_t> getNeighbors(size_t id) const {
-        Vec3f pos = Positions.at(id);
-        std::vector<size_t> candidates = spatialGrid.queryRange(pos, neighborRadius);
         std::vector<size_t> neighbors;
-        float radiusSq = neighborRadius * neighborRadius;
-        
-        for (size_t candidateId : candidates) {
-            if (candidateId == id) continue;
-            if (!Positions.contains(candidateId)) continue;
-
-            if (pos.distanceSquared(Positions.at(candidateId)) <= radiusSq) {
-                if (Pixels.find(candidateId) != Pixels.end()) {
-                    std::cerr << "NOT IN PIXELS! ERROR! ERROR!" <<std::endl;
-                    continue;
-                }
-                neighbors.push_back(candidateId);
-            }
-        }
+        forEachNeighbor(id, neighborRadius, [&](size_t neighborId) {
+            neighbors.push_back(neighborId);
+        });
         return neighbors;
     }
 
     std::vector<size_t> getNeighborsRange(size_t id, float dist) const {
-        Vec3f pos = Positions.at(id);
-        std::vector<size_t> candidates = spatialGrid.queryRange(pos, neighborRadius);
-        
         std::vector<size_t> neighbors;
-        float radiusSq = dist * dist;
-        
-        for (size_t candidateId : candidates) {
-            if (candidateId != id && pos.distanceSquared(Positions.at(candidateId)) <= radiusSq) {
-                neighbors.push_back(candidateId);
-            }
-        }
-        
+        forEachNeighbor(id, dist, [&](size_t neighborId) {
+            neighbors.push_back(neighborId);
+        });
         return neighbors;
     }
 
@@ -840,7 +1653,7 @@ public:
             for (size_t y = Min.y; y < Max.y; y++) {
                 for (size_t z = Min.z; z < Max.z; z++) {
                     Vec3f pos = Vec3f(x,y,z);
-                    if (Positions.contains(pos)) continue;
+                    if (voxels.contains(BrickMap3::cellOf(pos))) continue;
                     Vec4ui8 color = defaultBackgroundColor;
                     float size = 0.1;
                     newPos.push_back(pos);
@@ -854,26 +1667,24 @@ public:
     
     bool checkConsistency() const {
         std::cout << "=== Consistency Check ===" << std::endl;
-        std::cout << "Positions size: " << Positions.size() << std::endl;
-        std::cout << "Pixels size: " << Pixels.size() << std::endl;
-        
-        // Check 1: All Pixels should have corresponding Positions
-        for (const auto& [id, voxel] : Pixels) {
-            if (!Positions.contains(id)) {
-                std::cout << "ERROR: Pixel ID " << id << " not in Positions!" << std::endl;
-                return false;
-            }
-        }
-        
-        // Check 2: All Positions should have corresponding Pixels (maybe not always true?)
-        for (const auto& [id, pos] : Positions) {
-            if (Pixels.find(id) == Pixels.end()) {
-                std::cout << "ERROR: Position ID " << id << " not in Pixels!" << std::endl;
-                std::cout << "  Position: " << pos << std::endl;
-                return false;
+        std::cout << "Voxels size: " << voxels.size() << std::endl;
+
+        // every voxel's ID must name its own cell, and the store's count must match its bricks
+        size_t counted = 0;
+        bool ok = true;
+        voxels.forEachVoxel([&](const Vec3i& cell, const Vec4ui8&) {
+            counted++;
+            if (ok && cellOfID(idOf(cell)) != cell) {
+                std::cout << "ERROR: cell " << cell << " does not round-trip through its ID!" << std::endl;
+                ok = false;
             }
+        });
+        if (!ok) return false;
+        if (counted != voxels.size()) {
+            std::cout << "ERROR: " << counted << " voxels in bricks for a count of " << voxels.size() << "!" << std::endl;
+            return false;
         }
-        
+
         std::cout << "Consistency check passed!" << std::endl;
         return true;
     }
@@ -1,346 +1,580 @@
 #ifndef VOXELOCTREE_HPP
 #define VOXELOCTREE_HPP
 
+#include "grid3.hpp"
 #include "../vectorlogic/vec3.hpp"
-#include "../compression/zstd.hpp"
-#include "../inttypes.hpp"
-#include "../utils.hpp"
+#include "../vectorlogic/vec4.hpp"
+#include "../timing_decorator.hpp"
 #include <memory>
 #include <vector>
-#include <iostream>
 #include <algorithm>
+#include <numeric>
+#include <execution>
 #include <fstream>
 #include <array>
 #include <cstdint>
 #include <cmath>
 #include <bit>
-#include <stdio.h>
-
-
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+/// @brief Voxels sorted by Morton code, the input to VoxelOctree.
+/// @details Cells are shifted so the scene's minimum corner is the origin, then each voxel becomes a 63-bit
+/// Morton key (21 bits per axis) next to its packed RGBA color. Every aligned power-of-two cube is one
+/// contiguous run of keys, so cube queries are binary searches and an octree level is a pass over the keys.
 class VoxelData {
-private:
-};
-
-static const uint32_t BitCount[] = {
-    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-    4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
-};
+public:
+    struct Entry {
+        uint64_t key;
+        uint32_t color;
+    };
 
-constexpr float EPSILON = 0.0000000000000000000000001;
-static const size_t CompressionBlockSize = 64*1024*1024;
+    static constexpr int MAX_SIDE = 1 << 21;
 
-class VoxelOctree {
 private:
-    static const size_t MaxScale = 23;
-    size_t _octSize;
-    std::vector<uint32_t> _octree;
-    VoxelData* _voxels;
-    Vec3f _center;
-
-    size_t buildOctree(ChunkedAllocator<uint32_t>& allocator, int x, int y, int z, int size, size_t descriptorIndex) {
-        _voxels->prepateDataAccess(x, y, z, size);
-
-        int halfSize = size >> 1;
-        const std::array<Vec3f, 8> childPositions = {
-            Vec3f{x + halfSize, y + halfSize, z + halfSize},
-            Vec3f{x,           y + halfSize, z + halfSize},
-            Vec3f{x + halfSize, y,           z + halfSize},
-            Vec3f{x,           y,           z + halfSize},
-            Vec3f{x + halfSize, y + halfSize, z},
-            Vec3f{x,           y + halfSize, z},
-            Vec3f{x + halfSize, y,           z},
-            Vec3f{x,           y,           z}
-        };
-        uint64_t childOffset = static_cast<uint64_t>(allocator.size()) - descriptorIndex;
-
-        int childCount = 0;
-        std::array<int, 8> childIndices{};
-        uint32_t childMask = 0;
-
-        for (int i = 0; i < 8; ++i) {
-            if (_voxels->cubeContainsVoxelsDestructive(childPositions[i].x, childPositions[i].y, childPositions[i].z, halfSize)) {
-                childMask |= 128 >> i;
-                childIndices[childCount++] = i;
-            }
-        }
+    std::vector<Entry> entries;
+    Vec3i origin = Vec3i(0, 0, 0);
+    int side = 2;
+
+    static uint64_t spread(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
 
-        bool hasLargeChildren = false;
-        uint32_t leafMask;
-        if (halfSize == 1) {
-            leafMask = 0;
-            for (int i = 0; i < childCount; ++i) {
-                int idx = childIndices[childCount - i - 1];
-                allocator.pushBack(_voxels->getVoxelDestructive(childPositions[idx].x, childPositions[idx].y, childPositions[idx].z));
-            }
-        } else {
-            leafMask = childMask;
-            for (int i = 0; i < childCount; ++i) allocator.pushBack(0);
-            std::array<uint64_t, 8> granChildOffsets{};
-            uint64_t delta = 0;
-            uint64_t insertionCount = allocator.insertionCount();
-
-            for (int i = 0; i < childCount; ++i) {
-                int idx = childIndices[childCount - i - 1];
-                granChildOffsets[i] = delta + buildOctree(allocator, childPositions[idx].x, childPositions[idx].y, childPositions[idx].z, halfSize, descriptorIndex + childOffset + i);
-                delta += allocator.insertionCount() - insertionCount;
-                insertionCount = allocator.insertionCount();
-                if (granChildOffsets[i] > 0x3FFF) hasLargeChildren = true;
-            }
+    static uint32_t compact(uint64_t v) {
+        v &= 0x1249249249249249ull;
+        v = (v ^ (v >> 2)) & 0x10c30c30c30c30c3ull;
+        v = (v ^ (v >> 4)) & 0x100f00f00f00f00full;
+        v = (v ^ (v >> 8)) & 0x1f0000ff0000ffull;
+        v = (v ^ (v >> 16)) & 0x1f00000000ffffull;
+        v = (v ^ (v >> 32)) & 0x1fffffull;
+        return static_cast<uint32_t>(v);
+    }
 
-            for (int i = 0; i < childCount; ++i) {
-                uint64_t childIdx = descriptorIndex + childOffset + i;
-                uint64_t offset = granChildOffsets[i];
+    /// @brief Picks the origin and cube side for cells spanning [lo, hi]; the origin is a multiple of align.
+    void fitBounds(Vec3i lo, const Vec3i& hi, int align) {
+        auto down = [align](int v) { return v >= 0 ? v / align * align : -((-v + align - 1) / align) * align; };
+        origin = Vec3i(down(lo.x), down(lo.y), down(lo.z));
+        long extent = std::max({long(hi.x) - origin.x, long(hi.y) - origin.y, long(hi.z) - origin.z}) + 1;
+        if (extent > MAX_SIDE) throw std::length_error("voxel data spans more than 2^21 cells");
+        side = static_cast<int>(std::bit_ceil(static_cast<unsigned long>(std::max<long>(extent, std::max(align, 2)))));
+    }
 
-                if (hasLargeChildren) {
-                    offset += childCount - i;
-                    allocator.insert(childIdx + 1, static_cast<uint32_t>(offset));
-                    allocator[childIdx] |= 0x20000;
-                    offset >>= 32;
-                }
-                allocator[childIdx] |= static_cast<uint32_t>(offset << 18);
+    /// @brief Fills the entries from count cells and colors given by index, then sorts them.
+    template<typename CellAt, typename ColorAt>
+    void fromCells(size_t count, CellAt&& cellAt, ColorAt&& colorAt) {
+        if (count == 0) return;
+        // bounds per block, then combined; avoids an index array as large as the input
+        size_t blockCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()) * 16, count);
+        size_t blockSize = (count + blockCount - 1) / blockCount;
+        std::vector<std::pair<Vec3i, Vec3i>> bounds(blockCount, {cellAt(0), cellAt(0)});
+        std::for_each(std::execution::par, bounds.begin(), bounds.end(), [&](std::pair<Vec3i, Vec3i>& box) {
+            size_t b = &box - bounds.data();
+            for (size_t i = b * blockSize; i < std::min(count, (b + 1) * blockSize); ++i) {
+                Vec3i cell = cellAt(i);
+                box.first = Vec3i(std::min(box.first.x, cell.x), std::min(box.first.y, cell.y), std::min(box.first.z, cell.z));
+                box.second = Vec3i(std::max(box.second.x, cell.x), std::max(box.second.y, cell.y), std::max(box.second.z, cell.z));
             }
+        });
+        Vec3i lo = bounds[0].first;
+        Vec3i hi = bounds[0].second;
+        for (const auto& box : bounds) {
+            lo = Vec3i(std::min(lo.x, box.first.x), std::min(lo.y, box.first.y), std::min(lo.z, box.first.z));
+            hi = Vec3i(std::max(hi.x, box.second.x), std::max(hi.y, box.second.y), std::max(hi.z, box.second.z));
         }
+        fitBounds(lo, hi, 1);
+        entries.resize(count);
+        std::for_each(std::execution::par, entries.begin(), entries.end(), [&](Entry& entry) {
+            size_t i = &entry - entries.data();
+            Vec3i cell = cellAt(i);
+            entry = Entry{mortonEncode(cell.x - origin.x, cell.y - origin.y, cell.z - origin.z), packColor(colorAt(i))};
+        });
+        sortEntries();
+    }
 
-        allocator[descriptorIndex] = (childMask << 8) | leafMask;
-        if (hasLargeChildren) allocator[descriptorIndex] |= 0x10000;
-        return childOffset;
+    /// @brief Sorts the entries by key and drops duplicate cells, keeping one of their colors.
+    /// @details An unstable sort, since a stable one needs a second buffer as large as the entries.
+    void sortEntries() {
+        std::sort(std::execution::par, entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.key < b.key; });
+        auto last = std::unique(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.key == b.key; });
+        entries.erase(last, entries.end());
     }
+
 public:
-    VoxelOctree(const std::string& path) : _voxels(nullptr) {
-        std::ifstream file = std::ifstream(path, std::ios::binary);
-        if (!file.isopen()) {
-            throw std::runtime_error(std::string("failed to open: ") + path);
-        }
+    static uint64_t mortonEncode(uint32_t x, uint32_t y, uint32_t z) {
+        return spread(x) | (spread(y) << 1) | (spread(z) << 2);
+    }
 
-        float cd[3];
-        file.read(reinterpret_cast<char*>(cd), sizeof(float) * 3);
-        _center = Vec3f(cd);
+    static Vec3i mortonDecode(uint64_t key) {
+        return Vec3i(compact(key), compact(key >> 1), compact(key >> 2));
+    }
 
-        uint64_t octreeSize;
-        file.read(reinterpret_cast<char*>(&octreeSize), sizeof(uint64_t));
-        _octSize = octreeSize;
+    static uint32_t packColor(const Vec4ui8& color) {
+        return uint32_t(color.r) | (uint32_t(color.g) << 8) | (uint32_t(color.b) << 16) | (uint32_t(color.a) << 24);
+    }
 
-        _octree.resize(_octSize);
+    static Vec4ui8 unpackColor(uint32_t color) {
+        return Vec4ui8(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, color >> 24);
+    }
 
-        std::vector<uint8_t> compressionBuffer(zstd(static_cast<int>(CompressionBlockSize)));
+    VoxelData() = default;
 
-        std::unique_ptr<ZSTD_Stream, decltype(&ZSTD_freeStreamDecode)> stream(ZSTD_freeStreamDecode);
-        ZSTD_setStreamDecode(stream.get(), reinterpret_cast<char*>(_octree.data()), 0);
+    /// @brief From matching arrays of integer cells and colors; a cell listed twice keeps one of its colors.
+    VoxelData(const std::vector<Vec3i>& cells, const std::vector<Vec4ui8>& colors) {
+        TIME_FUNCTION;
+        if (cells.size() != colors.size()) throw std::invalid_argument("cells and colors differ in length");
+        fromCells(cells.size(), [&](size_t i) { return cells[i]; }, [&](size_t i) { return colors[i]; });
+    }
 
-        uint64_t compressedSize = 0;
-        const size_t elementSize = sizeof(uint32_t);
-        for (uint64_t offset = 0; offset < _octSize * elementSize; offset += CompressionBlockSize) {
-            uint64_t compsize;
-            file.read(reinterpret_cast<char*>(&compsize), sizeof(uint64_t));
+    /// @brief From Grid3's brick store, without a global sort.
+    /// @details The origin is aligned to the brick size, so each 8^3 brick is a contiguous run of 512 keys.
+    /// Sorting the bricks by their first key and emitting each brick's voxels in Morton order leaves the
+    /// whole array sorted; bricks are emitted in parallel into their prefix-summed ranges.
+    explicit VoxelData(const BrickMap3& bricks) {
+        TIME_FUNCTION;
+        if (bricks.empty()) return;
+        struct Source {
+            uint64_t key;
+            uint32_t slot;
+            size_t start;
+        };
+        std::vector<Source> sources;
+        sources.reserve(bricks.brickCount());
+        Vec3i lo(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+        Vec3i hi(std::numeric_limits<int>::min(), std::numeric_limits<int>::min(), std::numeric_limits<int>::min());
+        bricks.forEachBrick([&](uint32_t slot, const Vec3i& coord, const Chunk3&) {
+            sources.push_back(Source{0, slot, 0});
+            lo = Vec3i(std::min(lo.x, coord.x), std::min(lo.y, coord.y), std::min(lo.z, coord.z));
+            hi = Vec3i(std::max(hi.x, coord.x), std::max(hi.y, coord.y), std::max(hi.z, coord.z));
+        });
+        const int B = Chunk3::SIZE;
+        fitBounds(lo * B, hi * B + Vec3i(B - 1, B - 1, B - 1), B);
+        for (Source& source : sources) {
+            Vec3i base = bricks.brickCoord(source.slot) * B - origin;
+            source.key = mortonEncode(base.x, base.y, base.z);
+        }
+        std::sort(std::execution::par, sources.begin(), sources.end(), [](const Source& a, const Source& b) { return a.key < b.key; });
+        size_t total = 0;
+        for (Source& source : sources) {
+            source.start = total;
+            total += bricks.brick(source.slot).count();
+        }
 
-            if (compsize > compressionBuffer.size()) compressionBuffer.resize(compsize);
-            file.read(compressionBuffer.data(), static_cast<std::streamsize>(compsize));
+        // brick-local Morton order, as indices into Chunk3's x-fastest layout
+        std::array<uint16_t, Chunk3::VOLUME> order;
+        for (int m = 0; m < Chunk3::VOLUME; ++m) {
+            Vec3i local = mortonDecode(m);
+            order[m] = static_cast<uint16_t>(Chunk3::index(local.x, local.y, local.z));
+        }
+        entries.resize(total);
+        std::for_each(std::execution::par, sources.begin(), sources.end(), [&](const Source& source) {
+            const Chunk3& brick = bricks.brick(source.slot);
+            size_t out = source.start;
+            for (int m = 0; m < Chunk3::VOLUME; ++m) {
+                if (!brick.has(order[m])) continue;
+                entries[out++] = Entry{source.key + m, packColor(brick.colors[order[m]])};
+            }
+        });
+    }
 
-            int outsize = std::min(_octSize * elementSize - offset, CompressionBlockSize);
-            ZSTD_Decompress_continue(stream.get(), compressionBuffer.data(), reinterpret_cast<char*>(_octree.data()) + offset, outsize);
+    explicit VoxelData(const Grid3& grid) : VoxelData(grid.getVoxels()) {}
+
+    /// @brief From a VoxelGrid (util/voxelgrid.hpp): occupied cells with float 0-1 colors.
+    /// @details Reads the grid's arrays in place; the only new allocation is the sorted entries.
+    template<typename VoxelGridT>
+    static VoxelData fromVoxelGrid(const VoxelGridT& grid) {
+        TIME_FUNCTION;
+        const auto& positions = grid.getOccupiedPositions();
+        const auto& colors = grid.getColors();
+        if (positions.size() != colors.size()) throw std::invalid_argument("positions and colors differ in length");
+        auto toByte = [](float v) { return static_cast<uint8_t>(std::clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f); };
+        VoxelData data;
+        data.fromCells(positions.size(),
+            [&](size_t i) {
+                return Vec3i(static_cast<int>(std::floor(positions[i].x)), static_cast<int>(std::floor(positions[i].y)),
+                             static_cast<int>(std::floor(positions[i].z)));
+            },
+            [&](size_t i) { return Vec4ui8(toByte(colors[i].x), toByte(colors[i].y), toByte(colors[i].z), toByte(colors[i].w)); });
+        return data;
+    }
 
-            compressedSize += compsize + sizeof(uint64_t);
-        }
+    size_t size() const {
+        return entries.size();
     }
 
-    VoxelOctree(VoxelData* voxels) : _voxels(voxels) {
-        std::unique_ptr<ChunkedAllocator<uint32_t>> octreeAllocator = std::make_unique<ChunkedAllocator<uint32_t>>();
+    bool empty() const {
+        return entries.empty();
+    }
 
-        octreeAllocator->pushBack(0);
-        buildOctree(*octreeAllocator, 0, 0, 0, _voxels->sideLength(), 0);
-        (*octreeAllocator)[0] |= 1 << 18;
+    const std::vector<Entry>& sorted() const {
+        return entries;
+    }
 
-        _octSize = octreeAllocator->size() + octreeAllocator-> insertionCount();
-        _octree = octreeAllocator->finalize();
-        _center = _voxels->getCenter();
+    /// @brief World cell at key 0.
+    const Vec3i& getOrigin() const {
+        return origin;
     }
 
-    void save(const char* path) {
-        std::ofstream file(path, std::iod::binary);
-        if (!file.is_open()) {
-            throw std::runtime_error(std::string("failed to write: ") + path);
-        }
+    /// @brief Side of the power-of-two cube, in cells, that holds every voxel.
+    int sideLength() const {
+        return side;
+    }
 
-        float cd[3] = {_center.x,_center.y, _center.z};
+    Vec3f getCenter() const {
+        return Vec3f(origin.x, origin.y, origin.z) + Vec3f(side, side, side) * 0.5f;
+    }
 
-        file.write(reinterpret_cast<const char*>(cd), sizeof(float) * 3);
+    /// @brief Entry range [first, last) inside the aligned cube of the given size at local cell (x, y, z).
+    std::pair<size_t, size_t> cubeRange(int x, int y, int z, int size) const {
+        uint64_t begin = mortonEncode(x, y, z);
+        uint64_t end = begin + uint64_t(size) * size * size;
+        auto less = [](const Entry& e, uint64_t key) { return e.key < key; };
+        auto first = std::lower_bound(entries.begin(), entries.end(), begin, less);
+        auto last = std::lower_bound(first, entries.end(), end, less);
+        return {size_t(first - entries.begin()), size_t(last - entries.begin())};
+    }
 
-        file.write(reinterpret_cast<const char*>(static_cast<uint64_t>(_octSize)), sizeof(uint64_t));
-        std::vector<uint8_t> compressionBuffer(ZSTD_compressBound(static_cast<int>(CompressionBlockSize)));
-        std::unique_ptr<ZSTD_stream_t, decltype(&ZSTD_freeStream)> stream(ZSTD_createStream(), ZSTD_freeStream);
+    bool cubeContainsVoxels(int x, int y, int z, int size) const {
+        auto range = cubeRange(x, y, z, size);
+        return range.first != range.second;
+    }
 
-        ZSTD_resetStream(stream.get());
+    /// @brief Packed color of the voxel at local cell (x, y, z).
+    bool getVoxel(int x, int y, int z, uint32_t& color) const {
+        auto range = cubeRange(x, y, z, 1);
+        if (range.first == range.second) return false;
+        color = entries[range.first].color;
+        return true;
+    }
+};
 
-        uint64_t compressedSize = 0;
-        const size_t elementSize = sizeof(uint32_t);
-        const char* src = reinterpret_cast<const char*>(_octree.data());
+/// @brief Sparse voxel octree with the voxels' packed colors as leaves.
+/// @details Nodes are two words: the descriptor ((childMask << 8) | leafMask, with bit i for child octant i,
+/// x = bit 0, y = bit 1, z = bit 2) and the absolute index of the node's first child. The children of a
+/// node are contiguous in octant order; interior children are two words each, leaf children are one word
+/// holding the voxel's color. Nodes are stored level by level from the root, with the leaves last.
+/// Absolute child indices fit 32 bits up to ~3 * 10^9 words, which removes the far pointers of
+/// Laine & Karras' relative layout.
+class VoxelOctree {
+private:
+    static constexpr int MaxScale = 21;
+    static constexpr uint32_t FileMagic = 0x4f565353;
+    std::vector<uint32_t> _octree;
+    Vec3i _origin = Vec3i(0, 0, 0);
+    int _side = 0;
+
+    struct Level {
+        std::vector<uint64_t> codes;
+        std::vector<uint8_t> masks;
+        std::vector<uint64_t> firstChild;
+    };
+
+    /// @brief Groups the sorted child codes into their parents (code >> 3) in parallel.
+    /// @details The codes are split into blocks; a block owns the runs that start inside it. Blocks count
+    /// their runs, an exclusive scan gives each block its output offset, then every block writes its parents.
+    template<typename CodeAt>
+    static Level buildLevel(size_t count, CodeAt&& codeAt) {
+        Level level;
+        size_t blockCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()) * 16, (count + 4095) / 4096);
+        blockCount = std::max<size_t>(blockCount, 1);
+        size_t blockSize = (count + blockCount - 1) / blockCount;
+        std::vector<size_t> blocks(blockCount);
+        std::iota(blocks.begin(), blocks.end(), 0);
+        std::vector<size_t> runs(blockCount + 1, 0);
+        auto startsRun = [&](size_t i) { return i == 0 || (codeAt(i) >> 3) != (codeAt(i - 1) >> 3); };
+        std::for_each(std::execution::par, blocks.begin(), blocks.end(), [&](size_t b) {
+            size_t n = 0;
+            for (size_t i = b * blockSize; i < std::min(count, (b + 1) * blockSize); ++i) n += startsRun(i);
+            runs[b + 1] = n;
+        });
+        std::inclusive_scan(runs.begin(), runs.end(), runs.begin());
+
+        size_t parents = runs[blockCount];
+        level.codes.resize(parents);
+        level.masks.resize(parents);
+        level.firstChild.resize(parents);
+        std::for_each(std::execution::par, blocks.begin(), blocks.end(), [&](size_t b) {
+            size_t out = runs[b];
+            for (size_t i = b * blockSize; i < std::min(count, (b + 1) * blockSize); ++i) {
+                if (!startsRun(i)) continue;
+                uint64_t parent = codeAt(i) >> 3;
+                uint8_t mask = 0;
+                // a run is at most the 8 children of one parent and may continue past the block end
+                for (size_t j = i; j < count && (codeAt(j) >> 3) == parent; ++j) mask |= uint8_t(1u << (codeAt(j) & 7));
+                level.codes[out] = parent;
+                level.masks[out] = mask;
+                level.firstChild[out] = i;
+                out++;
+            }
+        });
+        return level;
+    }
 
-        for (uint64_t offset = 0; offset < _octSize * elementSize; offset += CompressionBlockSize) {
-            int outSize = _octSize * elementSize - offset, CompressionBlockSize;
-            uint64_t compSize = ZSTD_Compress_continue(stream.get(), src+offset, compressionBuffer.data(), outSize);
+    /// @brief Ray/box slab test on [lo, lo + size]; returns the entry axis through face.
+    static bool clipBox(const Vec3f& o, const Vec3f& inv, const Vec3f& lo, float size, float& tIn, float& tOut, int& face) {
+        float t0 = 0.0f;
+        float t1 = std::numeric_limits<float>::max();
+        face = -1;
+        const float origin[3] = {o.x, o.y, o.z};
+        const float inverse[3] = {inv.x, inv.y, inv.z};
+        const float low[3] = {lo.x, lo.y, lo.z};
+        for (int axis = 0; axis < 3; ++axis) {
+            float ta = (low[axis] - origin[axis]) * inverse[axis];
+            float tb = (low[axis] + size - origin[axis]) * inverse[axis];
+            if (ta > tb) std::swap(ta, tb);
+            if (ta > t0) {
+                t0 = ta;
+                face = axis;
+            }
+            t1 = std::min(t1, tb);
+        }
+        tIn = t0;
+        tOut = t1;
+        return t0 <= t1;
+    }
 
-            file.write(reinterpret_cast<const char*>(&compSize), sizeof(uint64_t));
-            file.write(compressionBuffer.data(), static_cast<std::streamsize>(compSize));
+public:
+    VoxelOctree() = default;
+
+    /// @brief Builds the octree bottom-up from Morton-sorted voxels.
+    /// @details Each level is the previous level's codes shifted right by 3, grouped in parallel (see
+    /// buildLevel). Once every level's size is known, the words are laid out root first and filled in parallel.
+    explicit VoxelOctree(const VoxelData& voxels) {
+        TIME_FUNCTION;
+        _origin = voxels.getOrigin();
+        _side = voxels.sideLength();
+        if (voxels.empty()) return;
+        const std::vector<VoxelData::Entry>& leaves = voxels.sorted();
+        int depth = std::countr_zero(static_cast<unsigned>(_side));
+
+        // levels[l] holds the nodes one level above levels[l - 1]; levels[0] are the parents of the leaves
+        std::vector<Level> levels;
+        levels.reserve(depth);
+        levels.push_back(buildLevel(leaves.size(), [&](size_t i) { return leaves[i].key; }));
+        while (static_cast<int>(levels.size()) < depth) {
+            const std::vector<uint64_t>& below = levels.back().codes;
+            levels.push_back(buildLevel(below.size(), [&](size_t i) { return below[i]; }));
+            levels[levels.size() - 2].codes = std::vector<uint64_t>();
+        }
 
-            compressedSize += compSize + sizeof(uint64_t);
+        std::vector<uint64_t> base(depth + 1);
+        uint64_t words = 0;
+        for (int l = depth - 1; l >= 0; --l) {
+            base[l + 1] = words;
+            words += 2 * levels[l].masks.size();
         }
+        base[0] = words;
+        words += leaves.size();
+        if (words > std::numeric_limits<uint32_t>::max()) throw std::length_error("octree exceeds 2^32 words");
+
+        // the word count is exact, so the octree is filled in place with no staging buffer
+        _octree.resize(words);
+        uint32_t* out = _octree.data();
+        for (int l = 0; l < depth; ++l) {
+            const Level& level = levels[l];
+            uint64_t nodeBase = base[l + 1];
+            uint64_t childBase = base[l];
+            uint64_t childWords = l == 0 ? 1 : 2;
+            bool leafLevel = l == 0;
+            std::for_each(std::execution::par, level.masks.begin(), level.masks.end(), [&](const uint8_t& mask) {
+                size_t j = &mask - level.masks.data();
+                out[nodeBase + 2 * j] = (uint32_t(mask) << 8) | (leafLevel ? mask : 0);
+                out[nodeBase + 2 * j + 1] = static_cast<uint32_t>(childBase + childWords * level.firstChild[j]);
+            });
+        }
+        std::for_each(std::execution::par, leaves.begin(), leaves.end(), [&](const VoxelData::Entry& leaf) {
+            out[base[0] + (&leaf - leaves.data())] = leaf.color;
+        });
     }
-    
-    bool rayMarch(const Vec3f& origin, const Vec3f& dest, float rayScale, uint32_t& normal, float& t) {
-        struct StackEntry {
-            uint64_t offset;
-            float maxT;
-        };
 
-        std::array<StackEntry, MaxScale + 1> rayStack;
-
-        Vec3 invAbsD = -dest.abs().safeInverse();
-        uint8_t octantMask = dest.calculateOctantMask();
-        Vec3f bT = invAbsD * origin;
-        if (dest.x > 0) { bT.x = 3.0f * invAbsD.x - bT.x;}
-        if (dest.y > 0) { bT.y = 3.0f * invAbsD.y - bT.y;}
-        if (dest.z > 0) { bT.z = 3.0f * invAbsD.z - bT.z;}
-
-        float minT = (2.0f * invAbsD - bT).maxComp();
-        float maxT = (invAbsD - bT).minComp();
-        minT = std::max(minT, 0.0f);
-        uint32_t curr = 0;
-        uint64_t par = 0;
-
-        Vec3 pos(1.0f);
-        
-        int idx = 0;
-        Vec3 centerT = 1.5f * invAbsD - bT;
-        if (centerT.x > minT) { idx ^= 1; pos.x = 1.5f; }
-        if (centerT.y > minT) { idx ^= 2; pos.y = 1.5f; }
-        if (centerT.z > minT) { idx ^= 4; pos.z = 1.5f; }
-
-        int scale = MaxScale - 1;
-        float scaleExp2 = 0.5f;
-
-        while (scale < MaxScale) {
-            if (curr == 0) curr = _octree[par];
-
-            Vec3 cornerT = pos * invAbsD - bT;
-            float maxTC = cornerT.minComp();
-
-            int childShift = idx ^ octantMask;
-            uint32_t childMasks = curr << childShift;
-            if ((childMasks & 0x8000) && minT <= maxT) {
-                if (maxTC * rayScale >= scaleExp2) {
-                    t = maxTC;
-                    return true;
-                }
+    /// @brief Loads an octree written by save().
+    explicit VoxelOctree(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) throw std::runtime_error(std::string("failed to open: ") + path);
+        uint32_t magic = 0;
+        int32_t header[4];
+        uint64_t words = 0;
+        file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        file.read(reinterpret_cast<char*>(&words), sizeof(words));
+        if (!file || magic != FileMagic) throw std::runtime_error(std::string("not a voxel octree: ") + path);
+        _origin = Vec3i(header[0], header[1], header[2]);
+        _side = header[3];
+        _octree.resize(words);
+        file.read(reinterpret_cast<char*>(_octree.data()), static_cast<std::streamsize>(words * sizeof(uint32_t)));
+        if (!file) throw std::runtime_error(std::string("truncated voxel octree: ") + path);
+    }
 
-                float maxTV = std::min(maxTC, maxT);
-                float half = scaleExp2 * 0.5f;
-                Vec3f centerT = Vec3(half) * invAbsD + cornerT;
-
-                if (minT <= maxTV) {
-                    uint64_t childOffset = curr >> 18;
-                    if (curr & 0x20000) childOffset = (childOffset << 32) | static_cast<uint64_t>(_octree[par+1]);
-                    if (!(childMasks & 0x80)) {
-                        uint32_t maskIndex = ((childMasks >> (8 + childShift)) << childShift) & 127;
-                        normal = _octree[childOffset + par + BitCount[maskIndex]];
-                        break;
-                    }
-                    rayStack[scale].offset = par;
-                    rayStack[scale].maxT = maxT;
-                    uint32_t siblingCount = BitCount[childMasks & 127];
-
-                    par += childOffset + siblingCount;
-                    if (curr & 0x10000) par += siblingCount;
-                    idx = 0;
-
-                    --scale;
-                    scaleExp2 = half;
-                    if (centerT.x > minT) {
-                        idx ^= 1;
-                        pos.x += scaleExp2;
-                    }
-                    if (centerT.y > minT) {
-                        idx ^= 1;
-                        pos.y += scaleExp2;
-                    }
-                    if (centerT.z > minT) {
-                        idx ^= 1;
-                        pos.z += scaleExp2;
-                    }
+    void save(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) throw std::runtime_error(std::string("failed to write: ") + path);
+        int32_t header[4] = {_origin.x, _origin.y, _origin.z, _side};
+        uint64_t words = _octree.size();
+        file.write(reinterpret_cast<const char*>(&FileMagic), sizeof(FileMagic));
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(&words), sizeof(words));
+        file.write(reinterpret_cast<const char*>(_octree.data()), static_cast<std::streamsize>(words * sizeof(uint32_t)));
+    }
 
-                    maxT = maxTV;
-                    curr = 0;
-                    continue;
-                }
-            }
+    bool empty() const {
+        return _octree.empty();
+    }
 
-            int stepMask = 0;
-            if (cornerT.x <= maxTC) {
-                stepMask ^= 1;
-                pos.x -= scaleExp2;
-            }
-            if (cornerT.y <= maxTC) {
-                stepMask ^= 1;
-                pos.y -= scaleExp2;
-            }
-            if (cornerT.z <= maxTC) {
-                stepMask ^= 1;
-                pos.z -= scaleExp2;
-            }
+    size_t memoryUsage() const {
+        return _octree.size() * sizeof(uint32_t);
+    }
 
-            minT = maxTC;
-            idx ^= stepMask;
+    const std::vector<uint32_t>& words() const {
+        return _octree;
+    }
 
-            if ((idx & stepMask) != 0) {
-                uint32_t differingBits = 0;
-                if (stepMask & 1) {
-                    differingBits |= std::bit_cast<uint32_t>(pos.x) ^ std::bit_cast<uint32_t>(pos.x + scaleExp2);
-                }
-                if (stepMask & 2) {
-                    differingBits |= std::bit_cast<uint32_t>(pos.y) ^ std::bit_cast<uint32_t>(pos.y + scaleExp2);
-                }
-                if (stepMask & 4) {
-                    differingBits |= std::bit_cast<uint32_t>(pos.z) ^ std::bit_cast<uint32_t>(pos.z + scaleExp2);
-                }
+    /// @brief World cell at the octree's minimum corner.
+    const Vec3i& origin() const {
+        return _origin;
+    }
+
+    int sideLength() const {
+        return _side;
+    }
 
-                scale = (differingBits >> 23) - 127;
-                scale = std::bit_cast<float>(static_cast<uint32_t>((scale - MaxScale + 127) << 23));
+    Vec3f center() const {
+        return Vec3f(_origin.x, _origin.y, _origin.z) + Vec3f(_side, _side, _side) * 0.5f;
+    }
 
-                par = rayStack[scale].offset;
-                maxT = rayStack[scale].maxT;
+    /// @brief Color of the voxel at a world cell.
+    bool lookup(const Vec3i& cell, Vec4ui8& color) const {
+        if (_octree.empty()) return false;
+        Vec3i local = cell - _origin;
+        if (local.x < 0 || local.y < 0 || local.z < 0 || local.x >= _side || local.y >= _side || local.z >= _side) return false;
+        uint32_t node = 0;
+        for (int shift = std::countr_zero(static_cast<unsigned>(_side)) - 1; shift >= 0; --shift) {
+            uint32_t desc = _octree[node];
+            uint32_t mask = (desc >> 8) & 0xff;
+            int child = ((local.x >> shift) & 1) | (((local.y >> shift) & 1) << 1) | (((local.z >> shift) & 1) << 2);
+            if (!(mask & (1u << child))) return false;
+            uint32_t rank = std::popcount(mask & ((1u << child) - 1));
+            if (desc & 0xff) {
+                color = VoxelData::unpackColor(_octree[_octree[node + 1] + rank]);
+                return true;
+            }
+            node = _octree[node + 1] + 2 * rank;
+        }
+        return false;
+    }
 
-                int shX = std::bit_cast<uint32_t>(pos.x) >> scale;
-                int shY = std::bit_cast<uint32_t>(pos.y) >> scale;
-                int shZ = std::bit_cast<uint32_t>(pos.z) >> scale;
+    /// @brief Finds the first voxel along origin + t * dir (world cells, t >= 0).
+    /// @details Depth-first descent with children visited front to back: for a ray whose sign bits form
+    /// dirMask, octant order i ^ dirMask never visits a child before one that can occlude it, so the first
+    /// leaf hit is the nearest.
+    /// @return true on a hit, with the distance, the voxel color and the axis of the face that was hit.
+    bool rayMarch(const Vec3f& origin, const Vec3f& dir, float& t, Vec4ui8& color, int& face) const {
+        if (_octree.empty()) return false;
+        Vec3f o = origin - Vec3f(_origin.x, _origin.y, _origin.z);
+        auto safeInverse = [](float d) { return std::fabs(d) > 1e-12f ? 1.0f / d : std::copysign(1e12f, d); };
+        Vec3f inv(safeInverse(dir.x), safeInverse(dir.y), safeInverse(dir.z));
+        int dirMask = (dir.x < 0 ? 1 : 0) | (dir.y < 0 ? 2 : 0) | (dir.z < 0 ? 4 : 0);
 
-                pos.x = std::bit_cast<float>(shX << scale);
-                pos.y = std::bit_cast<float>(shY << scale);
-                pos.z = std::bit_cast<float>(shZ << scale);
-                
-                idx = (shX & 1) | ((shY & 1) << 1) | ((shZ & 1) << 2);
-                curr = 0;
+        struct StackEntry {
+            uint32_t node;
+            Vec3f lo;
+            float size;
+        };
+        std::array<StackEntry, 7 * MaxScale + 1> stack;
+        size_t top = 0;
+        float tIn, tOut;
+        if (!clipBox(o, inv, Vec3f(0, 0, 0), static_cast<float>(_side), tIn, tOut, face)) return false;
+        stack[top++] = StackEntry{0, Vec3f(0, 0, 0), static_cast<float>(_side)};
+
+        while (top > 0) {
+            StackEntry entry = stack[--top];
+            uint32_t desc = _octree[entry.node];
+            uint32_t first = _octree[entry.node + 1];
+            uint32_t mask = (desc >> 8) & 0xff;
+            float half = entry.size * 0.5f;
+            if (desc & 0xff) {
+                for (int k = 0; k < 8; ++k) {
+                    int child = k ^ dirMask;
+                    if (!(mask & (1u << child))) continue;
+                    Vec3f lo = entry.lo + Vec3f(child & 1, (child >> 1) & 1, (child >> 2) & 1) * half;
+                    int axis;
+                    if (!clipBox(o, inv, lo, half, tIn, tOut, axis)) continue;
+                    t = tIn;
+                    face = axis;
+                    color = VoxelData::unpackColor(_octree[first + std::popcount(mask & ((1u << child) - 1))]);
+                    return true;
+                }
+                continue;
+            }
+            // pushed back to front so the nearest child is popped first
+            for (int k = 7; k >= 0; --k) {
+                int child = k ^ dirMask;
+                if (!(mask & (1u << child))) continue;
+                Vec3f lo = entry.lo + Vec3f(child & 1, (child >> 1) & 1, (child >> 2) & 1) * half;
+                int axis;
+                if (!clipBox(o, inv, lo, half, tIn, tOut, axis)) continue;
+                stack[top++] = StackEntry{first + 2 * static_cast<uint32_t>(std::popcount(mask & ((1u << child) - 1))), lo, half};
             }
         }
-        if (scale >=MaxScale) return false;
-        t = minT;
-        return true;
+        return false;
     }
 
-    Vec3f center() const {
-        return _center;
+    /// @brief Ray-casts the octree from a perspective camera, shaded like Grid3::getGridAsFrame.
+    frame render(const Vec2& res, const Camera3& camera, frame::colormap outChannels = frame::colormap::RGB,
+                 const Vec4ui8& background = Vec4ui8(0, 0, 0, 255)) const {
+        TIME_FUNCTION;
+        size_t outputWidth = static_cast<size_t>(res.x);
+        size_t outputHeight = static_cast<size_t>(res.y);
+        if (outputWidth == 0 || outputHeight == 0) {
+            frame outframe = frame();
+            outframe.colorFormat = outChannels;
+            return outframe;
+        }
+        Vec3f forward, right, up;
+        camera.basis(forward, right, up);
+        float halfHeight = std::tan(camera.fov * 0.5f * static_cast<float>(M_PI) / 180.0f);
+        float halfWidth = halfHeight * outputWidth / static_cast<float>(outputHeight);
+        const float shade[3] = {0.8f, 1.0f, 0.6f};
+
+        size_t channels = Grid3::frameChannels(outChannels);
+        std::vector<uint8_t> pixels(outputWidth * outputHeight * channels);
+        constexpr size_t TILE = 16;
+        size_t tilesX = (outputWidth + TILE - 1) / TILE;
+        size_t tilesY = (outputHeight + TILE - 1) / TILE;
+        std::vector<size_t> tiles(tilesX * tilesY);
+        std::iota(tiles.begin(), tiles.end(), 0);
+        std::for_each(std::execution::par, tiles.begin(), tiles.end(), [&](size_t tile) {
+            size_t x0 = (tile % tilesX) * TILE;
+            size_t y0 = (tile / tilesX) * TILE;
+            for (size_t y = y0; y < std::min(y0 + TILE, outputHeight); ++y) {
+                float v = (1.0f - 2.0f * (y + 0.5f) / outputHeight) * halfHeight;
+                for (size_t x = x0; x < std::min(x0 + TILE, outputWidth); ++x) {
+                    float u = (2.0f * (x + 0.5f) / outputWidth - 1.0f) * halfWidth;
+                    Vec3f dir = (forward + right * u + up * v).normalized();
+                    Vec4ui8 color = background;
+                    Vec4ui8 hit;
+                    float t;
+                    int face;
+                    if (rayMarch(camera.position, dir, t, hit, face)) {
+                        float s = shade[face >= 0 ? face : 1];
+                        color = Vec4ui8(static_cast<uint8_t>(hit.r * s), static_cast<uint8_t>(hit.g * s),
+                                        static_cast<uint8_t>(hit.b * s), 255);
+                    }
+                    Grid3::writePixel(pixels.data() + (y * outputWidth + x) * channels, color, outChannels);
+                }
+            }
+        });
+
+        frame outframe(outputWidth, outputHeight, outChannels);
+        outframe.setData(std::move(pixels));
+        return outframe;
     }
 };
 
@@ -78,6 +78,25 @@ public:
         sourceSize = data.size();
     }
 
+    /// @brief Mutable access to the pixel bytes, for patching a frame in place.
+    /// @throws std::runtime_error if the frame is compressed.
+    std::vector<uint8_t>& mutableData() {
+        if (cformat != compresstype::RAW) {
+            throw std::runtime_error("Only raw frames can be modified in place");
+        }
+        return _data;
+    }
+
+    /// @brief Takes ownership of an already-built pixel buffer instead of copying it.
+    void setData(std::vector<uint8_t>&& data) {
+        sourceSize = data.size();
+        _data = std::move(data);
+        cformat = compresstype::RAW;
+        _compressedData.clear();
+        _compressedData.shrink_to_fit();
+        overheadmap.clear();
+    }
+
     const std::vector<uint8_t>& getData() const {
         return _data;
     }
@@ -0,0 +1,104 @@
+#ifndef MATERIAL_HPP
+#define MATERIAL_HPP
+
+#include "temp.hpp"
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+/// @brief Registry of thermal materials, indexed by the uint16_t stored in each Temp.
+/// @details Properties are kept as parallel arrays so diffusion kernels can gather them by index.
+/// Material 0 always exists and carries Temp's default properties; its diffusivity is derived like any other.
+class MaterialTable {
+private:
+    std::vector<std::string> names;
+    std::vector<float> conductivities;
+    std::vector<float> specificHeats;
+    std::vector<float> densities;
+    std::vector<float> diffusivities;
+    std::vector<float> rates;
+
+    uint16_t push(const std::string& name, float conductivity, float specificHeat, float density, float diffusivity) {
+        if (names.size() > std::numeric_limits<uint16_t>::max()) throw std::length_error("too many materials");
+        names.push_back(name);
+        conductivities.push_back(conductivity);
+        specificHeats.push_back(specificHeat);
+        densities.push_back(density);
+        diffusivities.push_back(diffusivity);
+        rates.push_back(Temp::relaxRate(diffusivity));
+        return static_cast<uint16_t>(names.size() - 1);
+    }
+
+public:
+    MaterialTable() {
+        add("default", Temp::DEFAULT_CONDUCTIVITY, Temp::DEFAULT_SPECIFIC_HEAT, Temp::DEFAULT_DENSITY);
+    }
+
+    /// @brief Registers a material; diffusivity is conductivity / (density * specificHeat).
+    /// @return Index to store in Temp::material.
+    uint16_t add(const std::string& name, float conductivity, float specificHeat, float density = 1.0f) {
+        return push(name, conductivity, specificHeat, density, conductivity / (density * specificHeat));
+    }
+
+    /// @brief Returns the index of a material with exactly these properties, registering it if needed.
+    /// @details The default properties resolve to material 0.
+    uint16_t findOrAdd(float conductivity, float specificHeat, float density = 1.0f) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (conductivities[i] == conductivity && specificHeats[i] == specificHeat && densities[i] == density) {
+                return static_cast<uint16_t>(i);
+            }
+        }
+        return add("material" + std::to_string(names.size()), conductivity, specificHeat, density);
+    }
+
+    /// @brief Index of a named material.
+    /// @throws std::out_of_range if no material has that name.
+    uint16_t find(const std::string& name) const {
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (names[i] == name) return static_cast<uint16_t>(i);
+        }
+        throw std::out_of_range("unknown material " + name);
+    }
+
+    size_t size() const {
+        return names.size();
+    }
+
+    const std::string& name(uint16_t material) const {
+        return names[material];
+    }
+
+    float conductivity(uint16_t material) const {
+        return conductivities[material];
+    }
+
+    float specificHeat(uint16_t material) const {
+        return specificHeats[material];
+    }
+
+    float density(uint16_t material) const {
+        return densities[material];
+    }
+
+    float diffusivity(uint16_t material) const {
+        return diffusivities[material];
+    }
+
+    /// @brief Relaxation rate per millisecond, see Temp::relaxRate().
+    float rate(uint16_t material) const {
+        return rates[material];
+    }
+
+    /// @brief Flat per-material arrays for kernels that gather by index.
+    const float* conductivityTable() const {
+        return conductivities.data();
+    }
+
+    const float* rateTable() const {
+        return rates.data();
+    }
+};
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include "../timing_decorator.hpp"
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <algorithm>
+
+/// @brief Splits each rendered frame's worth of simulated time into bounded substeps.
+/// @details The caller supplies the largest step its solver should take: a stability limit such as
+/// SPHSolver2::stableStep(), or an accuracy cap such as Grid2::maxHeatStep() (infinity for none). A frame
+/// asks for frameTime * timeScale of simulated time; that span is divided evenly into the fewest substeps
+/// that respect that step, so a frame never over-steps and never takes more substeps than needed.
+/// Substeps stop early once the frame's wall-clock budget is spent, and the unsimulated remainder carries
+/// over to the next frame (up to maxBacklog frames' worth, the rest is dropped rather than spiralling).
+/// Every substep is recorded in FunctionTimer under the scheduler's name.
+class SubstepScheduler {
+private:
+    std::string name;
+    float backlog = 0.0f;
+    double stepCost = 0.0;
+
+public:
+    /// simulated time per unit of frame time, > 1 runs faster than real time
+    float timeScale = 1.0f;
+    /// wall-clock seconds of substep work allowed per frame
+    double frameBudget = 1.0 / 30.0;
+    /// hard cap on substeps per frame
+    int maxSubsteps = 256;
+    /// fraction of the largest step actually used
+    float safety = 0.9f;
+    /// how many frames of unsimulated time may be carried forward
+    float maxBacklog = 4.0f;
+
+    /// @brief What the last advance() did.
+    struct Report {
+        int substeps = 0;
+        float substep = 0.0f;
+        float simulated = 0.0f;
+        float backlog = 0.0f;
+        double wallTime = 0.0;
+    };
+    Report last;
+
+    SubstepScheduler(const std::string& name = "substep") : name(name) {}
+
+    /// @brief Advances by one frame, calling step(dt) once per substep.
+    /// @param frameTime Frame duration, in the same units as stableStep.
+    /// @param stableStep Largest substep the solver should take; may be infinity.
+    /// @return Simulated time actually covered.
+    template<typename StepFn>
+    float advance(float frameTime, float stableStep, StepFn&& step) {
+        TIME_FUNCTION;
+        last = Report();
+        float wanted = frameTime * timeScale + backlog;
+        if (wanted <= 0.0f || stableStep <= 0.0f) {
+            backlog = 0.0f;
+            return 0.0f;
+        }
+        float limit = stableStep * safety;
+        int substeps = std::clamp(static_cast<int>(std::ceil(wanted / limit)), 1, std::max(1, maxSubsteps));
+        float dt = std::min(wanted / substeps, limit);
+
+        auto frameStart = std::chrono::steady_clock::now();
+        double elapsed = 0.0;
+        int taken = 0;
+        while (taken < substeps && (taken == 0 || elapsed + stepCost <= frameBudget)) {
+            auto start = std::chrono::steady_clock::now();
+            step(dt);
+            auto end = std::chrono::steady_clock::now();
+            double cost = std::chrono::duration<double>(end - start).count();
+            FunctionTimer::recordTiming(name, cost);
+            stepCost = stepCost > 0.0 ? 0.8 * stepCost + 0.2 * cost : cost;
+            elapsed = std::chrono::duration<double>(end - frameStart).count();
+            taken++;
+        }
+
+        float simulated = taken * dt;
+        backlog = std::clamp(wanted - simulated, 0.0f, frameTime * timeScale * maxBacklog);
+        last.substeps = taken;
+        last.substep = dt;
+        last.simulated = simulated;
+        last.backlog = backlog;
+        last.wallTime = elapsed;
+        return simulated;
+    }
+
+    /// @brief Drops any carried-over time, e.g. after the simulation state was replaced.
+    void reset() {
+        backlog = 0.0f;
+        last = Report();
+    }
+
+    /// @brief Smoothed wall-clock cost of one substep in seconds, 0 before the first step.
+    double averageStepCost() const {
+        return stepCost;
+    }
+};
+
+#endif
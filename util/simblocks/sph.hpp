@@ -0,0 +1,272 @@
+#ifndef SPH_HPP
+#define SPH_HPP
+
+#include "../vectorlogic/vec2.hpp"
+#include "../timing_decorator.hpp"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <execution>
+
+/// @brief 2D smoothed particle hydrodynamics step (weakly compressible, Muller et al. 2003 kernels).
+/// @details Particles live in flat arrays that are re-sorted by cell before every step, so each cell's
+/// particles are contiguous and a neighbor search is a scan over the 3x3 surrounding cell ranges. Density
+/// and force passes run in parallel over particles; each reads only the previous pass's output.
+/// Units are grid cells and seconds. Pressure is relative to each particle's rest density, so warmer,
+/// lighter water rises on its own.
+class SPHSolver2 {
+public:
+    struct Settings {
+        /// kernel radius in cells; about twice the particle spacing
+        float smoothing = 2.0f;
+        /// numerical speed of sound, pressure stiffness is its square; ~10x the fastest flow keeps density within 1%
+        float soundSpeed = 200.0f;
+        /// kinematic viscosity in cells^2/s, scaled per particle by its relative viscosity
+        float viscosity = 0.5f;
+        Vec2 gravity = Vec2(0.0f, 9.81f);
+        /// particles are kept inside [boundsMin, boundsMax] when set
+        bool bounded = false;
+        Vec2 boundsMin;
+        Vec2 boundsMax;
+        /// fraction of normal velocity kept when bouncing off a bound
+        float restitution = 0.3f;
+    };
+    Settings settings;
+
+    //particle arrays, all the same length and in cell-sorted order after each step
+    std::vector<size_t> ids;
+    std::vector<Vec2> positions;
+    std::vector<Vec2> velocities;
+    std::vector<Vec2> accelerations;
+    std::vector<float> masses;
+    std::vector<float> restDensities;
+    std::vector<float> viscosityScales;
+    std::vector<float> densities;
+    std::vector<float> pressures;
+
+private:
+    //cell table: particles of cell c are [cellStart[c], cellStart[c + 1])
+    float cellSize = 1.0f;
+    Vec2 origin;
+    size_t cellsX = 0;
+    size_t cellsY = 0;
+    std::vector<uint32_t> cellStart;
+    std::vector<uint32_t> cellOf;
+    std::vector<uint32_t> order;
+    float maxAcceleration = 0.0f;
+
+    template<typename T>
+    void permute(std::vector<T>& values, std::vector<T>& scratch) {
+        scratch.resize(values.size());
+        std::for_each(std::execution::par, order.begin(), order.end(), [&](uint32_t& slot) {
+            size_t i = &slot - order.data();
+            scratch[i] = values[slot];
+        });
+        values.swap(scratch);
+    }
+
+    /// @brief Counting sort of every particle array by row-major cell index.
+    void sortByCell() {
+        TIME_FUNCTION;
+        size_t n = positions.size();
+        Vec2 lo = std::transform_reduce(std::execution::par, positions.begin(), positions.end(),
+            Vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+            [](const Vec2& a, const Vec2& b) { return a.min(b); }, [](const Vec2& p) { return p; });
+        Vec2 hi = std::transform_reduce(std::execution::par, positions.begin(), positions.end(),
+            Vec2(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()),
+            [](const Vec2& a, const Vec2& b) { return a.max(b); }, [](const Vec2& p) { return p; });
+
+        // cells no smaller than the kernel radius; coarser if the particles are spread thin, so the table stays O(n)
+        cellSize = settings.smoothing;
+        Vec2 extent = hi - lo;
+        float area = (extent.x + cellSize) * (extent.y + cellSize);
+        float maxCells = 16.0f * n + 1024.0f;
+        if (area / (cellSize * cellSize) > maxCells) cellSize = std::sqrt(area / maxCells);
+        origin = lo;
+        cellsX = static_cast<size_t>(extent.x / cellSize) + 1;
+        cellsY = static_cast<size_t>(extent.y / cellSize) + 1;
+
+        cellOf.resize(n);
+        std::for_each(std::execution::par, positions.begin(), positions.end(), [&](const Vec2& p) {
+            size_t i = &p - positions.data();
+            size_t cx = std::min(static_cast<size_t>((p.x - origin.x) / cellSize), cellsX - 1);
+            size_t cy = std::min(static_cast<size_t>((p.y - origin.y) / cellSize), cellsY - 1);
+            cellOf[i] = static_cast<uint32_t>(cy * cellsX + cx);
+        });
+
+        cellStart.assign(cellsX * cellsY + 1, 0);
+        for (size_t i = 0; i < n; ++i) cellStart[cellOf[i] + 1]++;
+        std::inclusive_scan(cellStart.begin(), cellStart.end(), cellStart.begin());
+        order.resize(n);
+        std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < n; ++i) order[fill[cellOf[i]]++] = static_cast<uint32_t>(i);
+
+        std::vector<Vec2> vecScratch;
+        std::vector<float> floatScratch;
+        std::vector<size_t> idScratch;
+        permute(ids, idScratch);
+        permute(positions, vecScratch);
+        permute(velocities, vecScratch);
+        permute(accelerations, vecScratch);
+        permute(masses, floatScratch);
+        permute(restDensities, floatScratch);
+        permute(viscosityScales, floatScratch);
+        densities.resize(n);
+        pressures.resize(n);
+    }
+
+    /// @brief Calls fn(j, offset, distSq) for every particle j within the kernel radius of position p.
+    template<typename Func>
+    void forEachNeighbor(const Vec2& p, Func&& fn) const {
+        float h = settings.smoothing;
+        float hSq = h * h;
+        long cx = static_cast<long>((p.x - origin.x) / cellSize);
+        long cy = static_cast<long>((p.y - origin.y) / cellSize);
+        long reach = static_cast<long>(std::ceil(h / cellSize));
+        long x0 = std::max(0L, cx - reach);
+        long x1 = std::min(static_cast<long>(cellsX) - 1, cx + reach);
+        long y0 = std::max(0L, cy - reach);
+        long y1 = std::min(static_cast<long>(cellsY) - 1, cy + reach);
+        for (long y = y0; y <= y1; ++y) {
+            // cells of a row are adjacent, so the whole span is one contiguous particle range
+            uint32_t begin = cellStart[y * cellsX + x0];
+            uint32_t end = cellStart[y * cellsX + x1 + 1];
+            for (uint32_t j = begin; j < end; ++j) {
+                Vec2 offset = p - positions[j];
+                float distSq = offset.lengthSquared();
+                if (distSq < hSq) fn(j, offset, distSq);
+            }
+        }
+    }
+
+    void computeDensity() {
+        TIME_FUNCTION;
+        float h = settings.smoothing;
+        float hSq = h * h;
+        float poly6 = 4.0f / (static_cast<float>(M_PI) * std::pow(h, 8.0f));
+        float stiffness = settings.soundSpeed * settings.soundSpeed;
+        std::for_each(std::execution::par, positions.begin(), positions.end(), [&](const Vec2& p) {
+            size_t i = &p - positions.data();
+            float density = 0.0f;
+            forEachNeighbor(p, [&](uint32_t j, const Vec2&, float distSq) {
+                float d = hSq - distSq;
+                density += masses[j] * d * d * d;
+            });
+            densities[i] = density * poly6;
+            // no suction: particles only push apart, which keeps free surfaces from clumping
+            pressures[i] = std::max(0.0f, stiffness * (densities[i] - restDensities[i]));
+        });
+    }
+
+    void computeForces() {
+        TIME_FUNCTION;
+        float h = settings.smoothing;
+        float spiky = -30.0f / (static_cast<float>(M_PI) * std::pow(h, 5.0f));
+        float viscLap = 40.0f / (static_cast<float>(M_PI) * std::pow(h, 5.0f));
+        float nu = settings.viscosity;
+        std::vector<float> accel(positions.size());
+        std::for_each(std::execution::par, positions.begin(), positions.end(), [&](const Vec2& p) {
+            size_t i = &p - positions.data();
+            Vec2 pressureAcc;
+            Vec2 viscAcc;
+            float rhoI = densities[i];
+            forEachNeighbor(p, [&](uint32_t j, const Vec2& offset, float distSq) {
+                if (j == i) return;
+                float r = std::sqrt(distSq);
+                float rhoJ = densities[j];
+                float q = h - r;
+                if (r > 1e-6f) {
+                    Vec2 grad = offset * (spiky * q * q / r);
+                    pressureAcc -= grad * (masses[j] * (pressures[i] + pressures[j]) / (2.0f * rhoJ * rhoI));
+                }
+                float scale = 0.5f * (viscosityScales[i] + viscosityScales[j]);
+                viscAcc += (velocities[j] - velocities[i]) * (scale * masses[j] * viscLap * q / rhoJ);
+            });
+            accelerations[i] = pressureAcc + viscAcc * nu + settings.gravity;
+            accel[i] = accelerations[i].length();
+        });
+        maxAcceleration = accel.empty() ? 0.0f : *std::max_element(accel.begin(), accel.end());
+    }
+
+    void integrate(float dt) {
+        std::for_each(std::execution::par, positions.begin(), positions.end(), [&](Vec2& p) {
+            size_t i = &p - positions.data();
+            Vec2& v = velocities[i];
+            v += accelerations[i] * dt;
+            p += v * dt;
+            if (!settings.bounded) return;
+            if (p.x < settings.boundsMin.x) { p.x = settings.boundsMin.x; v.x = -v.x * settings.restitution; }
+            if (p.x > settings.boundsMax.x) { p.x = settings.boundsMax.x; v.x = -v.x * settings.restitution; }
+            if (p.y < settings.boundsMin.y) { p.y = settings.boundsMin.y; v.y = -v.y * settings.restitution; }
+            if (p.y > settings.boundsMax.y) { p.y = settings.boundsMax.y; v.y = -v.y * settings.restitution; }
+        });
+    }
+
+public:
+    size_t size() const {
+        return positions.size();
+    }
+
+    void clear() {
+        ids.clear();
+        positions.clear();
+        velocities.clear();
+        accelerations.clear();
+        masses.clear();
+        restDensities.clear();
+        viscosityScales.clear();
+        densities.clear();
+        pressures.clear();
+    }
+
+    void reserve(size_t n) {
+        ids.reserve(n);
+        positions.reserve(n);
+        velocities.reserve(n);
+        accelerations.reserve(n);
+        masses.reserve(n);
+        restDensities.reserve(n);
+        viscosityScales.reserve(n);
+    }
+
+    /// @param mass Particle mass; a particle's share of area is mass / restDensity cells.
+    /// @param viscosityScale Multiplier on Settings::viscosity for this particle.
+    void add(size_t id, const Vec2& pos, const Vec2& velocity, float mass, float restDensity, float viscosityScale = 1.0f) {
+        ids.push_back(id);
+        positions.push_back(pos);
+        velocities.push_back(velocity);
+        accelerations.push_back(Vec2());
+        masses.push_back(mass);
+        restDensities.push_back(restDensity);
+        viscosityScales.push_back(viscosityScale);
+    }
+
+    /// @brief Largest step the next step() can take: CFL on sound speed plus flow, the last acceleration,
+    /// and the explicit viscosity limit.
+    float stableStep() const {
+        if (positions.empty()) return 0.0f;
+        float h = settings.smoothing;
+        float maxSpeedSq = std::transform_reduce(std::execution::par, velocities.begin(), velocities.end(), 0.0f,
+            [](float a, float b) { return std::max(a, b); }, [](const Vec2& v) { return v.lengthSquared(); });
+        float step = 0.4f * h / (settings.soundSpeed + std::sqrt(maxSpeedSq));
+        float accel = std::max(maxAcceleration, settings.gravity.length());
+        if (accel > 0.0f) step = std::min(step, 0.25f * std::sqrt(h / accel));
+        float maxScale = *std::max_element(viscosityScales.begin(), viscosityScales.end());
+        if (settings.viscosity * maxScale > 0.0f) step = std::min(step, 0.125f * h * h / (settings.viscosity * maxScale));
+        return step;
+    }
+
+    /// @brief Advances every particle by dt (semi-implicit Euler).
+    void step(float dt) {
+        TIME_FUNCTION;
+        if (positions.empty()) return;
+        sortByCell();
+        computeDensity();
+        computeForces();
+        integrate(dt);
+    }
+};
+
+#endif
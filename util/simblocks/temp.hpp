@@ -4,13 +4,14 @@
 #include "../vectorlogic/vec2.hpp"
 #include "../timing_decorator.hpp"
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
 
 class Temp {
 private:
 
 protected:
-    static Vec2 findClosestPoint(const Vec2& position, std::unordered_map<Vec2, Temp> others) {
+    static Vec2 findClosestPoint(const Vec2& position, const std::unordered_map<Vec2, Temp>& others) {
         if (others.empty()) {
             return position;
         }
@@ -31,10 +32,18 @@ protected:
     
 
 public:
+    //properties of material 0, see MaterialTable
+    static constexpr float DEFAULT_CONDUCTIVITY = 0.5f;
+    static constexpr float DEFAULT_SPECIFIC_HEAT = 900.0f;
+    static constexpr float DEFAULT_DENSITY = 1.0f;
+    /// k / (rho * c), derived the same way as every other material
+    static constexpr float DEFAULT_DIFFUSIVITY = DEFAULT_CONDUCTIVITY / (DEFAULT_DENSITY * DEFAULT_SPECIFIC_HEAT);
+    /// relaxation rate of the default material per millisecond
+    static constexpr float DEFAULT_RATE = 20.0f;
+
     float temp;
-    float conductivity = 0.5;
-    float specific_heat = 900.0;
-    float diffusivity = 2000.0;
+    /// index into the owning grid's MaterialTable
+    uint16_t material = 0;
     
     Temp() : temp(0.0) {};
     Temp(float temp) : temp(temp) {};
@@ -77,33 +86,41 @@ public:
         return num / den;
     }
     
-    void calLapl(const Vec2& testPos, const std::unordered_map<Vec2, Temp>& others, float deltaTime) {
+    /// @brief Neighbor weight used by calLapl: inverse square distance, zero when too close or past the search radius.
+    static float laplWeight(float dist) {
+        float searchRadius = 25.0f;
+        if (dist < 0.001f || dist > searchRadius) return 0.0f;
+        return 1.0f / (dist * dist);
+    }
+
+    /// @brief Relaxation rate (per millisecond) for a diffusivity k / (rho * c).
+    /// @details Rates scale with diffusivity, anchored so the default material relaxes at DEFAULT_RATE.
+    static float relaxRate(float diffusivity) {
+        return diffusivity * (DEFAULT_RATE / DEFAULT_DIFFUSIVITY);
+    }
+
+    /// @brief Temperature after relaxing toward equilibriumTemp for deltaTime at the given rate (see relaxRate()).
+    float relaxed(float equilibriumTemp, float deltaTime, float rate) const {
+        float lerpFactor = 1.0f - std::exp(-rate * deltaTime);
+        return this->temp + (equilibriumTemp - this->temp) * lerpFactor;
+    }
+
+    /// @brief Relaxes toward the inverse-square weighted mean of others at rate, which the caller looks up
+    /// for this object's material (see MaterialTable::rate()).
+    void calLapl(const Vec2& testPos, const std::unordered_map<Vec2, Temp>& others, float deltaTime, float rate) {
         //TIME_FUNCTION;
-        float dt = deltaTime;
         float sumWeights = 0.0f;
         float sumTempWeights = 0.0f;
-        float searchRadius = 25.0f;
 
         for (const auto& [point, tempObj] : others) {
-            float dist = testPos.distance(point);
-            
-            if (dist < 0.001f || dist > searchRadius) continue;
-
-            float weight = 1.0f / (dist * dist);
-
+            float weight = laplWeight(testPos.distance(point));
             sumTempWeights += weight * tempObj.temp;
             sumWeights += weight;
         }
 
         if (sumWeights < 1e-10f) return;
 
-        float equilibriumTemp = sumTempWeights / sumWeights;
-
-        float rate = this->diffusivity * 0.01f;
-        
-        float lerpFactor = 1.0f - std::exp(-rate * dt);
-
-        this->temp += (equilibriumTemp - this->temp) * lerpFactor;
+        this->temp = relaxed(sumTempWeights / sumWeights, deltaTime, rate);
     }
     
 };
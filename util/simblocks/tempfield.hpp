@@ -0,0 +1,121 @@
+#ifndef TEMPFIELD_HPP
+#define TEMPFIELD_HPP
+
+#include "../vectorlogic/vec2.hpp"
+#include "../timing_decorator.hpp"
+#include <vector>
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <execution>
+
+/// @brief Static KD-tree over temperature samples with k-nearest inverse distance weighting.
+/// @details The tree is implicit: samples are reordered so that the middle element of every range splits it
+/// on alternating axes, so there are no node allocations and a query only touches two flat arrays.
+/// Rebuild it with build() whenever the samples change.
+class TempField {
+private:
+    std::vector<Vec2> points;
+    std::vector<float> temps;
+
+    struct Candidate {
+        float distSq;
+        size_t index;
+    };
+
+    void buildRange(std::vector<size_t>& order, size_t lo, size_t hi, int axis) {
+        if (hi - lo <= 1) return;
+        size_t mid = lo + (hi - lo) / 2;
+        std::nth_element(order.begin() + lo, order.begin() + mid, order.begin() + hi, [&](size_t a, size_t b) {
+            return axis == 0 ? points[a].x < points[b].x : points[a].y < points[b].y;
+        });
+        buildRange(order, lo, mid, axis ^ 1);
+        buildRange(order, mid + 1, hi, axis ^ 1);
+    }
+
+    /// @brief Keeps the k closest candidates sorted by distance in best[0..count).
+    void searchRange(const Vec2& query, size_t lo, size_t hi, int axis, Candidate* best, size_t k, size_t& count) const {
+        if (lo >= hi) return;
+        size_t mid = lo + (hi - lo) / 2;
+        float distSq = query.distanceSquared(points[mid]);
+        if (count < k || distSq < best[count - 1].distSq) {
+            size_t slot = count < k ? count++ : count - 1;
+            while (slot > 0 && best[slot - 1].distSq > distSq) {
+                best[slot] = best[slot - 1];
+                slot--;
+            }
+            best[slot] = Candidate{distSq, mid};
+        }
+        float delta = axis == 0 ? query.x - points[mid].x : query.y - points[mid].y;
+        size_t nearLo = delta < 0 ? lo : mid + 1;
+        size_t nearHi = delta < 0 ? mid : hi;
+        size_t farLo = delta < 0 ? mid + 1 : lo;
+        size_t farHi = delta < 0 ? hi : mid;
+        searchRange(query, nearLo, nearHi, axis ^ 1, best, k, count);
+        if (count < k || delta * delta < best[count - 1].distSq) {
+            searchRange(query, farLo, farHi, axis ^ 1, best, k, count);
+        }
+    }
+public:
+    static constexpr size_t MAX_K = 32;
+
+    /// @brief Builds the tree from matching arrays of sample positions and temperatures.
+    void build(const std::vector<Vec2>& positions, const std::vector<float>& values) {
+        TIME_FUNCTION;
+        points = positions;
+        std::vector<size_t> order(points.size());
+        std::iota(order.begin(), order.end(), 0);
+        buildRange(order, 0, order.size(), 0);
+        std::vector<Vec2> sortedPoints(order.size());
+        temps.resize(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            sortedPoints[i] = positions[order[i]];
+            temps[i] = values[order[i]];
+        }
+        points = std::move(sortedPoints);
+    }
+
+    size_t size() const {
+        return points.size();
+    }
+
+    bool empty() const {
+        return points.empty();
+    }
+
+    void clear() {
+        points.clear();
+        temps.clear();
+    }
+
+    /// @brief Inverse distance weighted temperature from the k nearest samples (weights 1/d^power, like
+    /// Temp::calTempIDW). A query that lands on a sample returns that sample's temperature.
+    float idw(const Vec2& query, size_t k = 8, float power = 2.0f) const {
+        if (points.empty()) return 0.0f;
+        k = std::clamp<size_t>(k, 1, MAX_K);
+        Candidate best[MAX_K];
+        size_t count = 0;
+        searchRange(query, 0, points.size(), 0, best, k, count);
+        if (best[0].distSq < 1e-12f) return temps[best[0].index];
+        float num = 0.0f;
+        float den = 0.0f;
+        for (size_t i = 0; i < count; ++i) {
+            float weight = power == 2.0f ? 1.0f / best[i].distSq : 1.0f / std::pow(best[i].distSq, power * 0.5f);
+            num += weight * temps[best[i].index];
+            den += weight;
+        }
+        return num / den;
+    }
+
+    /// @brief idw() for many query points at once, in parallel.
+    std::vector<float> idwBatch(const std::vector<Vec2>& queries, size_t k = 8, float power = 2.0f) const {
+        TIME_FUNCTION;
+        std::vector<float> out(queries.size());
+        std::transform(std::execution::par, queries.begin(), queries.end(), out.begin(), [&](const Vec2& query) {
+            return idw(query, k, power);
+        });
+        return out;
+    }
+};
+
+#endif
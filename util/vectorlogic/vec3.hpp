@@ -127,7 +127,7 @@ public:
         return x * other.x + y * other.y + z * other.z;
     }
     
-    Vec3& cross(const Vec3& other) const {
+    Vec3 cross(const Vec3& other) const {
         return Vec3(
             y * other.z - z * other.y,
             z * other.x - x * other.z,